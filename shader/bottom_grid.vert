@@ -20,17 +20,17 @@ void main() {
         return;
     }
 
-    uint cellIndex = surfaceCells[gl_InstanceIndex];
+    uint cellIndex = selectParticleSet(surfaceCells[gl_InstanceIndex], numCells);
     uvec3 cellIndices = to3D(cellIndex, N);
 
-    vec3 cellPos = areaOrigin + areaSize * (cellIndices / vec3(N)) + cellSize / 2.0;
+    vec3 cellPos = getGridOrigin() + getGridSize() * (cellIndices / vec3(N)) + getCellSize() / 2.0;
 
     float scale = 0.95;
-    vec4 worldPos = vec4((inPosition * cellSize * 0.5 * scale + cellPos), 1);
+    vec4 worldPos = vec4((inPosition * getCellSize() * 0.5 * scale + cellPos), 1);
 
     uint mcCase = computeMarchingCubesCase(cellIndices);
     uint numVerts = vertexCounts[mcCase];
-    uint numTris = triangleCounts[mcCase];
+    uint numTris = getTriangleCount(getTriangles(mcCase));
     if(numTris == 0){
         gl_Position = vec4(0);
         return;
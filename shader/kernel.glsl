@@ -12,16 +12,20 @@ float P(float d, float h)
 
 float isotropicKernel(vec3 r, float h)
 {
-    r *= pushConstants.kernelScale;
-    h *= pushConstants.kernelScale;
+    r *= getKernelScale();
+    h *= getKernelScale();
     float d = length(r);
     return P(d / h, h) / cubic(h);
 }
 
-float computeDensity(in uvec3 globalVertexIndices, in uint num)
+// The attributes of the particles are summed with the same kernel weights, in the same loop,
+// if they are transferred. Otherwise attribute is zero.
+float computeDensity(in uvec3 globalVertexIndices, in uint num, out vec4 attribute)
 {
-    vec3 vertexPos = areaOrigin + cellSize * globalVertexIndices;
+    vec3 vertexPos = getGridOrigin() + getCellSize() * globalVertexIndices;
     float totalDensity = 0.0;
+    vec4 totalAttribute = vec4(0.0);
+    bool transferAttributes = gridConstants.transferAttributes != 0;
 
     //      -1     0
     //    -------------
@@ -31,7 +35,7 @@ float computeDensity(in uvec3 globalVertexIndices, in uint num)
     //  0 |     |     |
     //    |     |     |
     //    -------------
-    int offsetSize = int(pushConstants.kernelRadius / cellSize.x);
+    int offsetSize = int(getKernelRadius() / getCellSize().x);
     int offsetMin = -offsetSize - 1;
     int offsetMax = offsetSize;
 
@@ -50,11 +54,16 @@ float computeDensity(in uvec3 globalVertexIndices, in uint num)
                     uint particleIndex = getParticleIndex(neighborCellIndex, i);
                     vec3 particlePos = getParticlePosition(particleIndex);
                     vec3 r = vertexPos - particlePos;
-                    totalDensity += isotropicKernel(r, pushConstants.kernelRadius);
+                    float weight = isotropicKernel(r, getKernelRadius());
+                    totalDensity += weight;
+                    if(transferAttributes){
+                        totalAttribute += weight * getParticleAttribute(particleIndex);
+                    }
                 }
             }
         }
     }
 
+    attribute = totalAttribute;
     return totalDensity;
 }
@@ -10,3 +10,11 @@ void main() {
     gl_PointSize = pushConstants.pointSize;
     outColor = vec4(0.3, 0.3, 1.0, 1.0);
 }
+
+// Spray particles, which are not in the grids and thus not meshed
+void main_spray() {
+    vec3 position = getParticlePosition(sprayParticles[gl_VertexIndex]);
+    gl_Position = worldToNDC(position);
+    gl_PointSize = pushConstants.pointSize;
+    outColor = vec4(0.8, 0.9, 1.0, 1.0);
+}
@@ -5,6 +5,8 @@
 #include "shared.inc"
 
 //#define OUTPUT_MESHLET_INDEX
+//#define OUTPUT_PARTICLE_SET
+//#define OUTPUT_VELOCITY
 
 layout(binding = 1) buffer ParticlePositions
 {
@@ -29,6 +31,8 @@ layout(binding = 4) buffer SurfaceCounts
     uint surfaceVertexCount;
     uint densityCount;
     uint surfaceBlockCount;
+    uint sprayParticleCount;
+    uint capturedVertexCounts[maxParticleSets];  // of the frame, see main_capture_mesh
 };
 
 struct Vertex
@@ -37,9 +41,10 @@ struct Vertex
     vec4 normal;
 };
 
-layout(binding = 7) buffer TopGridValidCellCounts
+// A bit per cell containing particles, in the order of to1D(localCellIndices, K)
+layout(binding = 7) buffer BlockOccupancy
 {
-    uint topValidCellCounts[];
+    uvec2 blockOccupancy[];
 };
 
 layout(binding = 8) buffer SurfaceCells
@@ -47,9 +52,10 @@ layout(binding = 8) buffer SurfaceCells
     uint surfaceCells[];
 };
 
-layout(binding = 10) buffer SurfaceVertices
+// Surface vertices of each block: bit to1D(local vertex, K + 1) of the (K + 1)^3 vertices
+layout(binding = 10) buffer BlockVertexMasks
 {
-    uint surfaceVertices[];
+    uvec4 blockVertexMasks[];
 };
 
 layout(binding = 11) buffer CompressedVertices
@@ -57,16 +63,25 @@ layout(binding = 11) buffer CompressedVertices
     uint compressedVertices[];
 };
 
+// Encoded by storeDensity() and storeNormal()
 layout(binding = 12) buffer Density
 {
-    float densities[];
+    uint densities[];
 };
 
 layout(binding = 13) buffer CellVertexNormals
 {
-    vec4 cellVertexNormals[];
+    uint cellVertexNormals[];
 };
 
+// Grid, tile and frame state of each tile of the frame (see GridConstants in shared.inc)
+layout(binding = 14) buffer GridConstantSlots
+{
+    GridConstants gridConstantSlots[];
+};
+
+#define gridConstants gridConstantSlots[pushConstants.gridSlot]
+
 layout(binding = 15) buffer DispatchIndirectCommands
 {
     uvec4 counts[];
@@ -78,6 +93,87 @@ layout(binding = 16) buffer SurfaceBlocks
     uint surfaceBlocks[];
 };
 
+layout(binding = 17) buffer BlockLods
+{
+    uint blockLods[];
+};
+
+layout(binding = 18) buffer HiZ
+{
+    float hiZ[];
+};
+
+struct ParticleSetParams
+{
+    float isoValue;
+    float kernelRadius;
+    float kernelScale;
+    float padding;
+};
+
+layout(binding = 23) buffer ParticleSets
+{
+    ParticleSetParams particleSets[];
+};
+
+// Transform of each collider in the vertex arena
+layout(binding = 24) buffer ColliderTransforms
+{
+    mat4 colliderTransforms[];
+};
+
+// Host readable ring, read by the app a few frames after it is written
+layout(binding = 26) buffer Statistics
+{
+    SurfaceStatistics statistics[];
+};
+
+// Particles left out of the grids and drawn as points (see main_fill_grids)
+layout(binding = 27) buffer SprayParticles
+{
+    uint sprayParticles[];
+};
+
+// Particles per cell, counted before the grids are filled to classify the spray
+layout(binding = 28) buffer CellParticleCounts
+{
+    uint cellParticleCounts[];
+};
+
+// Triangle lists of the frames of an offline batch, written by main_capture_mesh and read by
+// the host, with the vertex counts of their regions copied by main_copy_captured_counts.
+// A count may exceed its region, the vertices beyond it are dropped.
+layout(binding = 29) buffer CapturedMeshes
+{
+    CapturedVertex capturedVertices[];
+};
+
+// Ordered compaction (GridConstants::orderedCompaction): the items of each workgroup or
+// invocation of a count pass, scanned in place into their offsets in the output
+layout(binding = 30) buffer CompactionOffsets
+{
+    uint compactionOffsets[];
+};
+
+// Attributes of the particles, in the order of ParticlePositions (see transferAttributes)
+layout(binding = 31) buffer ParticleAttributes
+{
+    vec4 particleAttributes[];
+};
+
+// Kernel-weighted average of the particle attributes at each grid vertex, written with the
+// densities. Zero where the density is zero.
+layout(binding = 32) buffer VertexAttributes
+{
+    vec4 vertexAttributes[];
+};
+
+// Vertex count of each region of CapturedMeshes
+layout(binding = 33) buffer CapturedCounts
+{
+    uint capturedCounts[];
+};
+
 layout(binding = 19) uniform samplerCube envRadianceImage;
 
 layout(binding = 20) uniform sampler2D posImage;
@@ -105,6 +201,170 @@ uint to1D(in uvec3 indices, in uint num)
     return (num * num * indices.z) + (num * indices.y) + (indices.x);
 }
 
+// Grid being processed: the whole area, or one tile of it in tiled mode
+vec3 getGridOrigin()
+{
+    return gridConstants.gridOrigin.xyz;
+}
+
+vec3 getCellSize()
+{
+    return vec3(gridConstants.gridOrigin.w);
+}
+
+vec3 getBlockSize()
+{
+    return getCellSize() * float(K);
+}
+
+vec3 getGridSize()
+{
+    return getCellSize() * float(N);
+}
+
+uint getParticleOffset()
+{
+    return gridConstants.tileInfo.x;
+}
+
+// Particle set processed by this invocation.
+// The grid buffers hold one layer per set, and the stored cell, block and vertex indices
+// include the layer.
+uint currentSet = 0;
+
+uint getParticleSetCount()
+{
+    return gridConstants.particleSetCount;
+}
+
+// Select the set of a layered index and return the index within the layer
+uint selectParticleSet(uint layeredIndex, uint layerSize)
+{
+    currentSet = layeredIndex / layerSize;
+    return layeredIndex % layerSize;
+}
+
+uint toLayered(uint index, uint layerSize)
+{
+    return currentSet * layerSize + index;
+}
+
+float getIsoValue()
+{
+    return particleSets[currentSet].isoValue;
+}
+
+float getKernelRadius()
+{
+    return particleSets[currentSet].kernelRadius;
+}
+
+float getKernelScale()
+{
+    return particleSets[currentSet].kernelScale;
+}
+
+bool hasLocalVertex(uvec4 mask, uint localVertexIndex)
+{
+    return ((mask[localVertexIndex / 32] >> (localVertexIndex % 32)) & 1) != 0;
+}
+
+// Two 16-bit densities share a word, so they are ORed into the cleared buffer
+void storeDensity(uint layeredVertexIndex, float density)
+{
+    uint format = gridConstants.storageFormat & densityFormatMask;
+    if(format == densityFloat32){
+        densities[layeredVertexIndex] = floatBitsToUint(density);
+        return;
+    }
+    uint bits = format == densityFloat16
+                    ? packHalf2x16(vec2(density, 0.0))
+                    : packUnorm2x16(vec2(density / (densityUnormRange * getIsoValue()), 0.0));
+    atomicOr(densities[layeredVertexIndex / 2], bits << (16 * (layeredVertexIndex % 2)));
+}
+
+float loadDensity(uint layeredVertexIndex)
+{
+    uint format = gridConstants.storageFormat & densityFormatMask;
+    if(format == densityFloat32){
+        return uintBitsToFloat(densities[layeredVertexIndex]);
+    }
+    uint bits = densities[layeredVertexIndex / 2] >> (16 * (layeredVertexIndex % 2));
+    return format == densityFloat16
+               ? unpackHalf2x16(bits).x
+               : unpackUnorm2x16(bits).x * densityUnormRange * getIsoValue();
+}
+
+// Octahedral mapping of the unit sphere to [-1, 1]^2
+vec2 encodeOctahedral(vec3 normal)
+{
+    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+    vec2 signs = vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    return normal.z >= 0.0 ? normal.xy : (1.0 - abs(normal.yx)) * signs;
+}
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 normal = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-normal.z, 0.0);
+    normal.xy += vec2(normal.x >= 0.0 ? -t : t, normal.y >= 0.0 ? -t : t);
+    return normalize(normal);
+}
+
+void storeNormal(uint layeredVertexIndex, vec3 normal)
+{
+    if((gridConstants.storageFormat & octahedralNormals) != 0){
+        cellVertexNormals[layeredVertexIndex] = packSnorm2x16(encodeOctahedral(normal));
+        return;
+    }
+    for(uint i = 0; i < 3; i++){
+        cellVertexNormals[layeredVertexIndex * 4 + i] = floatBitsToUint(normal[i]);
+    }
+    cellVertexNormals[layeredVertexIndex * 4 + 3] = floatBitsToUint(1.0);
+}
+
+vec3 loadNormal(uint layeredVertexIndex)
+{
+    if((gridConstants.storageFormat & octahedralNormals) != 0){
+        return decodeOctahedral(unpackSnorm2x16(cellVertexNormals[layeredVertexIndex]));
+    }
+    return uintBitsToFloat(uvec3(cellVertexNormals[layeredVertexIndex * 4 + 0],
+                                 cellVertexNormals[layeredVertexIndex * 4 + 1],
+                                 cellVertexNormals[layeredVertexIndex * 4 + 2]));
+}
+
+// The attribute at t on the edge between two grid vertices. A vertex without particles has no
+// average, so the other one is used instead of pulling the attribute to zero.
+// Zero if the attributes are not transferred.
+vec4 interpolateVertexAttribute(uint layeredVertex0, uint layeredVertex1, float t)
+{
+    if(gridConstants.transferAttributes == 0){
+        return vec4(0.0);
+    }
+    vec4 attribute0 = vertexAttributes[layeredVertex0];
+    vec4 attribute1 = vertexAttributes[layeredVertex1];
+    if(loadDensity(layeredVertex0) <= 0.0){
+        return attribute1;
+    }
+    if(loadDensity(layeredVertex1) <= 0.0){
+        return attribute0;
+    }
+    return mix(attribute0, attribute1, t);
+}
+
+float getDensity(uvec3 vertexIndices)
+{
+    return loadDensity(toLayered(to1D(vertexIndices, N + 1), numVertices));
+}
+
+// Blocks within the halo are only used as kernel support for the neighboring tile
+bool isOwnedBlock(in uvec3 blockIndices)
+{
+    uint haloBlocks = gridConstants.tileInfo.y;
+    return all(greaterThanEqual(blockIndices, uvec3(haloBlocks)))
+           && all(lessThan(blockIndices, uvec3(M - haloBlocks)));
+}
+
 bool isOutOfRange(in ivec3 indices, in uint num)
 {
     return any(lessThanEqual(indices, ivec3(-1))) || any(greaterThanEqual(indices, ivec3(num)));
@@ -145,37 +405,74 @@ const ivec3 neighborCellOffsets[] = ivec3[](ivec3(-1, -1, -1),
                                             ivec3(0, 1, 1),
                                             ivec3(1, 1, 1));
 
-// Assume that the cell contains particles <- If the particle count is zero, it could still be a
-// surface. Assume that the cell is not a boundary
+// Cells of a block with local indices in [minIndices, maxIndices], in the order of blockOccupancy
+uvec2 getBlockCellRangeMask(uvec3 minIndices, uvec3 maxIndices)
+{
+    uint x = ((1u << (maxIndices.x - minIndices.x + 1)) - 1) << minIndices.x;
+    uint y = ((1u << ((maxIndices.y - minIndices.y + 1) * K)) - 1) << (minIndices.y * K);
+    uint z = ((1u << (maxIndices.z - minIndices.z + 1)) - 1) << minIndices.z;
+    uint slice = (x * 0x1111u) & y; // cells of one z slice of 4x4
+    return uvec2(slice * ((z & 1u) | (z & 2u) << 15), slice * ((z & 4u) >> 2 | (z & 8u) << 13));
+}
+
+// Whether the cells of [minCellIndices, maxCellIndices] in the block contain particles.
+// Out of range blocks count as empty.
+void testOccupancy(ivec3 blockIndices, ivec3 minCellIndices, ivec3 maxCellIndices,
+                   inout bool anyOccupied, inout bool anyEmpty)
+{
+    ivec3 blockMin = blockIndices * K;
+    uvec3 minIndices = uvec3(max(minCellIndices, blockMin) - blockMin);
+    uvec3 maxIndices = uvec3(min(maxCellIndices, blockMin + K - 1) - blockMin);
+    uvec2 range = getBlockCellRangeMask(minIndices, maxIndices);
+    uvec2 occupied = uvec2(0);
+    if(!isOutOfRange(blockIndices, M)){
+        uint layeredBlockIndex = toLayered(to1D(uvec3(blockIndices), M), numBlocks);
+        occupied = blockOccupancy[layeredBlockIndex] & range;
+    }
+    anyOccupied = anyOccupied || any(notEqual(occupied, uvec2(0)));
+    anyEmpty = anyEmpty || any(notEqual(occupied, range));
+}
+
+// The cells in the kernel support are neither all empty nor all occupied.
+// A few masks of blocks are read instead of the particle counts of every cell.
+// Assume that the cell is not a boundary
 bool isSurface(in uvec3 cellIndices, in uint num)
 {
-    int offsetSize = int(pushConstants.kernelRadius / cellSize.x);
+    int offsetSize = int(getKernelRadius() / getCellSize().x);
     int offsetMin = -offsetSize - 1;
     int offsetMax = offsetSize + 1;
 
     ivec3 neiMins = clamp(ivec3(cellIndices) + ivec3(offsetMin), ivec3(0), ivec3(num - 1));
     ivec3 neiMaxs = clamp(ivec3(cellIndices) + ivec3(offsetMax), ivec3(0), ivec3(num - 1));
 
-    bool allEmpty = true;
-    bool allNotEmpty = true;
-    for (int x = neiMins.x; x <= neiMaxs.x; x++) {
-        for (int y = neiMins.y; y <= neiMaxs.y; y++) {
-            for (int z = neiMins.z; z <= neiMaxs.z; z++) {
-                ivec3 neighborCellIndices = ivec3(x, y, z);
-                uint index = to1D(uvec3(neighborCellIndices), num);
-                uint count = bottomParticleCounts[index];
-                allEmpty = allEmpty && count == 0u;
-                allNotEmpty = allNotEmpty && count > 0u;
+    bool anyOccupied = false;
+    bool anyEmpty = false;
+    for (int z = neiMins.z / K; z <= neiMaxs.z / K; z++) {
+        for (int y = neiMins.y / K; y <= neiMaxs.y / K; y++) {
+            for (int x = neiMins.x / K; x <= neiMaxs.x / K; x++) {
+                testOccupancy(ivec3(x, y, z), neiMins, neiMaxs, anyOccupied, anyEmpty);
             }
         }
     }
-    return !(allEmpty || allNotEmpty);
+    return anyOccupied && anyEmpty;
 }
 
-bool isSurfaceBlock(uint numCellsContainingParticles)
-{
-    return numCellsContainingParticles != 0
-           && numCellsContainingParticles != (K + 2) * (K + 2) * (K + 2);
+// The block and the cells around it are neither all empty nor all occupied
+bool isSurfaceBlock(uvec3 blockIndices)
+{
+    ivec3 minCellIndices = ivec3(blockIndices) * K - 1;
+    ivec3 maxCellIndices = ivec3(blockIndices) * K + K;
+    bool anyOccupied = false;
+    bool anyEmpty = false;
+    for (int z = -1; z <= 1; z++) {
+        for (int y = -1; y <= 1; y++) {
+            for (int x = -1; x <= 1; x++) {
+                testOccupancy(ivec3(blockIndices) + ivec3(x, y, z), minCellIndices, maxCellIndices,
+                              anyOccupied, anyEmpty);
+            }
+        }
+    }
+    return anyOccupied && anyEmpty;
 }
 
 float rand(in float i)
@@ -185,14 +482,14 @@ float rand(in float i)
 
 bool isOutOfArea(in vec3 worldPos)
 {
-    return any(lessThan(worldPos, areaOrigin + 1e-4))
-           || any(greaterThan(worldPos, areaOrigin + areaSize - 1e-4));
+    return any(lessThan(worldPos, getGridOrigin() + 1e-4))
+           || any(greaterThan(worldPos, getGridOrigin() + getGridSize() - 1e-4));
 }
 
 // Assume that worldPos in area
 uvec3 worldPosToCellIndices(in vec3 worldPos)
 {
-    return uvec3((worldPos - areaOrigin) * uvec3(N) / areaSize);
+    return uvec3((worldPos - getGridOrigin()) / getCellSize());
 }
 
 uint divRoundUp(in uint num, in uint den)
@@ -254,12 +551,14 @@ vec4 worldToNDC(vec3 position)
 
 uint getParticleCount(uint cellIndex)
 {
-    return min(bottomParticleCounts[cellIndex], maxParticlesPerCell);
+    return min(bottomParticleCounts[toLayered(cellIndex, numCells)], maxParticlesPerCell);
 }
 
 uint getParticleIndex(uint cellIndex, uint localIndex)
 {
-    return bottomParticleIndices[cellIndex * maxParticlesPerCell + localIndex];
+    uint slot = toLayered(cellIndex, numCells) * maxParticlesPerCell + localIndex;
+    uint index = bottomParticleIndices[slot];
+    return gridConstants.orderedCompaction != 0 ? ~index : index;  // see insertOrderedParticleIndex
 }
 
 vec3 getParticlePosition(uint particleIndex)
@@ -267,6 +566,17 @@ vec3 getParticlePosition(uint particleIndex)
     return particlePositions[particleIndex].xyz;
 }
 
+vec4 getParticleAttribute(uint particleIndex)
+{
+    return particleAttributes[particleIndex];
+}
+
+// The set index is stored in w
+uint getParticleSet(uint particleIndex)
+{
+    return uint(particlePositions[particleIndex].w);
+}
+
 vec3 gammaCorrect(vec3 color)
 {
     return pow(color, vec3(1.0 / 2.2));
@@ -45,6 +45,8 @@ float remapTo01(float value, float minValue, float maxValue) {
 layout (location = 0) in VertexInput {
     vec4 normal;
     vec4 pos;
+    vec4 attribute;
+    flat uint particleSet;
 #ifdef OUTPUT_MESHLET_INDEX
     flat uint meshletIndex;
 #endif
@@ -60,6 +62,17 @@ void main_mesh_shader() {
     return;
 #endif
 
+#ifdef OUTPUT_PARTICLE_SET
+    outColor = vec4(getMeshletColor(vertexInput.particleSet) * (computeLighting(normal)), 1);
+    return;
+#endif
+
+#ifdef OUTPUT_VELOCITY
+    vec3 velocityColor = clamp(abs(vertexInput.attribute.xyz) / 5.0, 0.0, 1.0);
+    outColor = vec4(velocityColor * computeLighting(normal), 1);
+    return;
+#endif
+
     // refract
     vec3 pos = vertexInput.pos.xyz;
     vec3 dir = normalize(pos - pushConstants.cameraPos.xyz);
@@ -97,5 +110,9 @@ void main_mesh_shader() {
     }
 
     vec3 color = refraction * (1.0 - fr) + reflection * fr;
+
+    // Foam is diffuse white. w is zero if the attributes are not transferred.
+    float foam = clamp(vertexInput.attribute.w, 0.0, 1.0);
+    color = mix(color, vec3(computeLighting(normal)), foam);
     outColor = vec4(gammaCorrect(color), 1.0);
 }
@@ -0,0 +1,8 @@
+// Payload from surface.task to surface.mesh
+
+struct SurfaceTaskPayload
+{
+    uint blockIndices[32];
+};
+
+taskPayloadSharedEXT SurfaceTaskPayload taskPayload;
@@ -5,25 +5,21 @@ layout(location = 0) out vec4 outColor;
 layout(location = 1) out vec3 outNormal;
 
 void main() {
-    uint vertexIndex = gl_VertexIndex;
-    if(vertexIndex >= (N+1) * (N+1) * (N+1)){
-        return;
-    }
-
-    uvec3 vertexIndices = to3D(vertexIndex, N + 1);
-    bool surface = surfaceVertices[vertexIndex] == 1;
-    if(!surface) {
+    if(gl_VertexIndex >= surfaceVertexCount) {
        gl_PointSize = 0;
        return;
     }
+
+    uint vertexIndex = selectParticleSet(compressedVertices[gl_VertexIndex], numVertices);
+    uvec3 vertexIndices = to3D(vertexIndex, N + 1);
     
-    vec3 position = areaOrigin + vertexIndices * cellSize;
+    vec3 position = getGridOrigin() + vertexIndices * getCellSize();
     gl_Position = worldToNDC(position);
     gl_PointSize = pushConstants.pointSize;
     outColor = vec4(0.8, 0.8, 0.8, 1.0);
 
-    float density = densities[vertexIndex];
-    if(density > pushConstants.isoValue){
+    float density = getDensity(vertexIndices);
+    if(density > getIsoValue()){
         outColor = vec4(1.0, 0.0, 0.0, 1.0);
     }
 }
@@ -20,11 +20,11 @@ void main() {
         return;
     }
 
-    uint blockIndex = surfaceBlocks[gl_InstanceIndex];
+    uint blockIndex = selectParticleSet(surfaceBlocks[gl_InstanceIndex], numBlocks);
     uvec3 blockIndices = to3D(blockIndex, M);
-    vec3 blockPos = areaOrigin + areaSize * (blockIndices / vec3(M)) + blockSize / 2.0;
+    vec3 blockPos = getGridOrigin() + getGridSize() * (blockIndices / vec3(M)) + getBlockSize() / 2.0;
 
-    vec4 worldPos = vec4((inPosition * blockSize * 0.5 + blockPos), 1);
+    vec4 worldPos = vec4((inPosition * getBlockSize() * 0.5 + blockPos), 1);
     gl_Position = pushConstants.viewProj * worldPos;
     outColor = vec4(0, 1, 0, 1);
 }
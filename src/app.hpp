@@ -1,15 +1,25 @@
 #pragma once
 
 #include <imgui.h>
+#include <array>
+#include <chrono>
+#include <functional>
 #include <glm/glm.hpp>
+#include <memory>
 #include <ranges>
 #include <reactive/Window.hpp>
 #include <reactive/reactive.hpp>
 #include <string>
 
 #include "../shader/shared.inc"
+#include "domain.hpp"
+#include "marching_cubes_table.hpp"
+#include "particle_stream.hpp"
 #include "pass.hpp"
+#include "reconstructor.hpp"
 #include "scene.hpp"
+#include "tiling.hpp"
+#include "transient_arena.hpp"
 
 struct ShaderInfo
 {
@@ -39,9 +49,75 @@ struct ComputePipeline
     rv::ComputePipelineHandle pipeline;
 };
 
+// Stages of renderSurface() and the debug draws, in which the grid buffers are live
+enum class SurfaceStage : uint32_t {
+    BuildGrids,
+    SurfaceBlock,
+    SurfaceCell,
+    CompressVertex,
+    Density,
+    Normal,
+    BlockLod,
+    Extract,
+    DebugDraw,
+    Count,
+};
+
+constexpr std::array<const char*, static_cast<size_t>(SurfaceStage::Count)> surfaceStageNames = {
+    "BuildGrids", "SurfaceBlock", "SurfaceCell", "CompressVertex", "Density",
+    "Normal",     "BlockLod",     "Extract",     "DebugDraw",
+};
+
+// Inputs of the surface stages in the last frame. A stage runs again only if its inputs or
+// the outputs of an earlier stage changed.
+struct StageInputs
+{
+    std::vector<glm::vec4> particles;
+    std::vector<ParticleSetParams> particleSets;
+    glm::vec4 gridOrigin{0.0f};
+    uint32_t storageFormat = 0;
+    glm::mat4 viewProj{0.0f};
+    glm::ivec2 resolution{0};
+    float lodCellPixels = 0.0f;
+    uint32_t sprayNeighborCount = 0;
+    uint32_t orderedCompaction = 0;
+    std::vector<glm::vec4> attributes;  // empty if the attributes are not transferred
+};
+
+// GPU timers of the surface passes of one tile, or of the whole grid
+struct SurfaceTimers
+{
+    rv::GPUTimerHandle compute;
+    rv::GPUTimerHandle rendering;
+    std::array<rv::GPUTimerHandle, 3> compaction;  // blocks, cells and vertices, within compute
+};
+
+// A frame of a pass of an offline batch
+struct BatchFrame
+{
+    uint32_t particleCount = 0;
+    glm::vec4 gridOrigin{0.0f};
+};
+
+// A pass of an offline batch, in a slot of the batch ring
+struct BatchPass
+{
+    uint32_t firstFrame = 0;
+    std::vector<BatchFrame> frames;  // empty if the slot is free
+};
+
+// Milliseconds of the surface passes
+struct SurfaceTimes
+{
+    float compute = 0.0f;
+    float rendering = 0.0f;
+    std::array<float, 3> compaction{};
+};
+
 class FluidApp final : public rv::App {
 public:
-    FluidApp()
+    // Particles are read from the particle stream of the given name instead of the scene file
+    explicit FluidApp(std::string particleStreamName = {})
         : rv::App({
             .width = 1920,
             .height = 1080,
@@ -50,7 +126,8 @@ public:
             .vsync = true,
             .layers = {rv::Layer::Validation, rv::Layer::FPSMonitor},
             .extensions = {rv::Extension::MeshShader, rv::Extension::ExtendedDynamicState},
-        })
+        }),
+          particleStreamName{std::move(particleStreamName)}
     {
     }
 
@@ -65,9 +142,50 @@ public:
 
     void onUpdate(float dt) override
     {
-        context.getQueue().waitIdle();
+        // The passes of an offline batch stay in flight, each in its own slot of the batch ring
+        if (!batchRunning) {
+            context.getQueue().waitIdle();
+        }
 
-        numParticles = scene.getParticleCount();
+        scene.updateColliders();
+        if (batchRunning) {
+            advanceBatch();
+        }
+        if (compactionBenchmarkFrames > 0) {
+            advanceCompactionBenchmark();
+        }
+
+        // Each motion sample of each particle set is a layer of the same pass,
+        // so the grids and buffers are set up once per frame
+        const uint32_t setCount = static_cast<uint32_t>(particleSetParams.size());
+        uint32_t layerCount = setCount * motionSamples;
+        std::span<const glm::vec4> particles = frameParticles;
+
+        // The attributes of the particles are gathered with them, in the same order
+        frameAttributes.clear();
+        std::vector<glm::vec4>* attributes = transferAttributes ? &frameAttributes : nullptr;
+        if (particleStream) {
+            // The latest frame of the simulator, read in place as a single layer.
+            // The stream has no attributes.
+            particleStream->update();
+            particles = particleStream->getFrame().particles;
+            layerCount = 1;
+            attributes = nullptr;
+        } else if (isCapturing()) {
+            // The frames of the batch pass instead of the motion samples, uploaded one by one
+            particles = {};
+            layerCount = setCount;
+        } else {
+            frameParticles.clear();
+            for (int i = 0; i < motionSamples; i++) {
+                float sampleTime = scene.time + shutter * static_cast<float>(i) / motionSamples;
+                scene.appendParticles(sampleTime, i * setCount, frameParticles, attributes);
+            }
+            particles = frameParticles;
+        }
+        gridConstants.transferAttributes = attributes ? 1 : 0;
+        reserveLayers(layerCount);
+        numParticles = static_cast<uint32_t>(particles.size());
 
         // Update camera
         camera.processKey();
@@ -80,11 +198,45 @@ public:
         pushConstants.viewProj = camera.getProj() * camera.getView();
         pushConstants.cameraPos = glm::vec4(camera.getPosition(), 1.0);
         pushConstants.resolution = {rv::Window::getWidth(), rv::Window::getHeight()};
-        pushConstants.maxParticleCount = numParticles;
-
-        std::memcpy(particleBuffer->map(), scene.getData(), scene.getSize());
+        gridConstants.maxParticleCount = numParticles;
+        updateParticleSets(layerCount);
+
+        if (isCapturing()) {
+            uploadBatchPass(attributes != nullptr);
+        } else if (tiledMode) {
+            // Plan every frame since the halo depends on the kernel radius
+            tilePlan = TilePlan{static_cast<uint32_t>(tileResolution), maxKernelRadius};
+            tilePlan.binParticles(particles.data(), numParticles, tileParticles,
+                                  attributes ? frameAttributes.data() : nullptr,
+                                  &tileAttributes);
+            reserveParticleBuffer(tileParticles.size());
+            reserveGridSlots(tilePlan.tiles.size());
+            reserveSurfaceTimers(tilePlan.tiles.size());
+            std::memcpy(particleBuffer->map(), tileParticles.data(),
+                        sizeof(glm::vec4) * tileParticles.size());
+            if (attributes) {
+                std::memcpy(particleAttributeBuffer->map(), tileAttributes.data(),
+                            sizeof(glm::vec4) * tileAttributes.size());
+            }
+        } else {
+            gridConstants.gridOrigin = glm::vec4{areaOrigin, cellSize.x};
+            if (autoDomain) {
+                ParticleBounds bounds = computeParticleBounds(
+                    particles.data(), numParticles, std::thread::hardware_concurrency());
+                gridConstants.gridOrigin = fitGridToBounds(bounds, maxKernelRadius);
+            }
+            gridConstants.tileInfo = glm::uvec4{0};
+            reserveParticleBuffer(particles.size());
+            std::memcpy(particleBuffer->map(), particles.data(),
+                        sizeof(glm::vec4) * particles.size());
+            if (attributes) {
+                std::memcpy(particleAttributeBuffer->map(), frameAttributes.data(),
+                            sizeof(glm::vec4) * frameAttributes.size());
+            }
+        }
 
-        if (runPhysics) {
+        // The scene is held while a batch runs, so that the colliders are not rewritten in flight
+        if (runPhysics && !batchRunning) {
             scene.update();
         }
     }
@@ -93,6 +245,15 @@ public:
     {
         renderGUI();
 
+        // The debug draws and the stage skipping toggled in the GUI may extend the lifetimes of
+        // the grid buffers
+        if (getLifetimeFlags() != plannedLifetimeFlags) {
+            reserveLayers(layerCapacity);
+            updateParticleSets(gridConstants.particleSetCount);
+        }
+        firstStage = findFirstDirtyStage();
+        compactionTimedMode = -1;
+
         // Clear images
         rv::ImageHandle colorImage = getCurrentColorImage();
         commandBuffer->clearColorImage(colorImage, {0.1f, 0.1f, 0.1f, 1.0f});
@@ -125,10 +286,11 @@ public:
             commandBuffer->bindPipeline(graphicsPipelines["Mesh"].pipeline);
             commandBuffer->pushConstants(graphicsPipelines["Mesh"].pipeline, &pushConstants);
 
-            for (auto& mesh : scene.meshes) {
-                commandBuffer->bindVertexBuffer(mesh.vertexBuffer);
-                commandBuffer->bindIndexBuffer(mesh.indexBuffer);
-                commandBuffer->drawIndexed(static_cast<uint32_t>(mesh.indices.size()), 1);
+            if (!scene.colliders.empty()) {
+                commandBuffer->bindVertexBuffer(scene.colliderVertexBuffer);
+                commandBuffer->bindIndexBuffer(scene.colliderIndexBuffer);
+                commandBuffer->drawIndexedIndirect(scene.colliderDrawCommandBuffer, 0, 1,
+                                                   sizeof(vk::DrawIndexedIndirectCommand));
             }
 
             commandBuffer->endRendering();
@@ -137,11 +299,68 @@ public:
         commandBuffer->transitionLayout(opaquePosImage, vk::ImageLayout::eShaderReadOnlyOptimal);
         commandBuffer->transitionLayout(opaqueColorImage, vk::ImageLayout::eShaderReadOnlyOptimal);
 
-        // Clear buffers
-        clearBuffers(commandBuffer);
+        // Build Hi-Z from the opaque depth
+        if (cullSurfaceBlocks) {
+            commandBuffer->beginDebugLabel("HiZ");
+            commandBuffer->transitionLayout(depthImage, vk::ImageLayout::eShaderReadOnlyOptimal);
+            hiZPass.run(commandBuffer);
+            commandBuffer->transitionLayout(depthImage,
+                                            vk::ImageLayout::eDepthStencilAttachmentOptimal);
+            commandBuffer->endDebugLabel();
+        }
+
+        gridConstants.statisticsSlot = frame % statisticsRingSize;
+        if (isCapturing()) {
+            // The frames of a batch pass share the grid buffers like the tiles, and each has its
+            // own slot for the grid constants, timers, particles and captured meshes.
+            // The previous frame may still be drawing, so the counters are cleared after it.
+            const BatchPass& pass = batchPasses[batchRingIndex];
+            const uint32_t setCount = static_cast<uint32_t>(particleSetParams.size());
+            for (uint32_t i = 0; i < pass.frames.size(); i++) {
+                uint32_t slot = batchRingIndex * batchPassCapacity + i;
+                gridConstants.gridOrigin = pass.frames[i].gridOrigin;
+                gridConstants.tileInfo = glm::uvec4{slot * scene.maxParticleCount, 0, i, 0};
+                gridConstants.maxParticleCount = pass.frames[i].particleCount;
+                gridConstants.captureRegionOffset = slot * setCount;
+                setGridSlot(slot);
+                commandBuffer->beginDebugLabel(
+                    ("Frame " + std::to_string(pass.firstFrame + i)).c_str());
+                waitForSurfaceDraws(commandBuffer);
+                clearBuffers(commandBuffer);
+                renderSurface(commandBuffer, surfaceTimers[slot]);
+                captureMeshes(commandBuffer);
+                commandBuffer->endDebugLabel();
+            }
+        } else if (tiledMode) {
+            // Tiles share the grid buffers, so they are processed one after another.
+            // Their statistics and times are summed.
+            for (size_t i = 0; i < tilePlan.tiles.size(); i++) {
+                tilePlan.setGridConstants(tilePlan.tiles[i], gridConstants);
+                gridConstants.tileInfo.z = static_cast<uint32_t>(i);
+                setGridSlot(static_cast<uint32_t>(i));
+                commandBuffer->beginDebugLabel(("Tile " + std::to_string(i)).c_str());
+                if (i > 0) {
+                    waitForSurfaceDraws(commandBuffer);
+                }
+                clearBuffers(commandBuffer);
+                renderSurface(commandBuffer, surfaceTimers[i]);
+                commandBuffer->endDebugLabel();
+            }
+            timedTileOffset = 0;
+            timedTileCount = tilePlan.tiles.size();
+        } else {
+            setGridSlot(0);
+
+            // The counters and indirect arguments of the skipped stages are kept
+            if (firstStage == SurfaceStage::BuildGrids) {
+                clearBuffers(commandBuffer);
+            }
 
-        // Render surface
-        renderSurface(commandBuffer);
+            // Render surface
+            renderSurface(commandBuffer, surfaceTimers[0]);
+            timedTileOffset = 0;
+            timedTileCount = 1;
+        }
 
         // Render debug elements
         {
@@ -157,7 +376,7 @@ public:
 
             // Draw surface vertex
             if (showSurfaceVertex) {
-                draw(commandBuffer, "SurfaceVertex", numVertices);
+                draw(commandBuffer, "SurfaceVertex", numVertices * gridConstants.particleSetCount);
             }
 
             // Draw bottom grid
@@ -184,6 +403,40 @@ public:
         frame++;
     }
 
+    // Time the compaction stages on the GPU for frameCount frames in each mode, and log the
+    // averages. The stages run every frame while the benchmark runs.
+    void startCompactionBenchmark(int frameCount)
+    {
+        compactionBenchmarkFrames = frameCount;
+        compactionBenchmarkMode = 0;
+        compactionBenchmarkSamples = 0;
+        compactionBenchmarkTimes = {};
+        compactionBenchmarkRestoredMode = gridConstants.orderedCompaction;
+    }
+
+    // Capture the meshes of all frames of the scene in passes of batchFrameCount frames
+    void startBatch()
+    {
+        batchRunning = true;
+        batchPassCapacity = 0;
+        batchNextFrame = 0;
+        batchRingIndex = batchRingSize - 1;
+        batchFrames = 0;
+        batchTriangleCount = 0;
+        batchTruncatedMeshes = 0;
+        batchTime = 0.0f;
+        batchStartTime = std::chrono::steady_clock::now();
+    }
+
+    // Receives the triangle list of each particle set of each frame of the offline batches,
+    // in the order of the frames. The vertices are only valid during the call.
+    using CapturedMeshConsumer =
+        std::function<void(int frame, uint32_t set, std::span<const CapturedVertex> vertices)>;
+    void setCapturedMeshConsumer(CapturedMeshConsumer consumer)
+    {
+        capturedMeshConsumer = std::move(consumer);
+    }
+
 private:
     void createGpuTimers()
     {
@@ -200,16 +453,46 @@ private:
             }
         }
 
-        gpuTimers[0] = context.createGPUTimer({});
-        gpuTimers[1] = context.createGPUTimer({});
+        reserveSurfaceTimers(1);
+    }
+
+    // Grow the surface timers to a set per tile
+    void reserveSurfaceTimers(size_t tileCount)
+    {
+        while (surfaceTimers.size() < tileCount) {
+            SurfaceTimers timers;
+            timers.compute = context.createGPUTimer({});
+            timers.rendering = context.createGPUTimer({});
+            for (auto& timer : timers.compaction) {
+                timer = context.createGPUTimer({});
+            }
+            surfaceTimers.push_back(std::move(timers));
+        }
+    }
+
+    // Times of the surface passes in the last frame, summed over its tiles or batch frames
+    SurfaceTimes getSurfaceTimes() const
+    {
+        SurfaceTimes times;
+        for (size_t i = timedTileOffset; i < timedTileOffset + timedTileCount; i++) {
+            times.compute += surfaceTimers[i].compute->elapsedInMilli();
+            times.rendering += surfaceTimers[i].rendering->elapsedInMilli();
+            for (size_t j = 0; j < times.compaction.size(); j++) {
+                times.compaction[j] += surfaceTimers[i].compaction[j]->elapsedInMilli();
+            }
+        }
+        return times;
     }
 
     void createScene()
     {
-        scene.load(ASSET_DIR + "FluidBeach.abc");
-        for (auto& mesh : scene.meshes) {
-            mesh.allocate(context);
+        if (particleStreamName.empty()) {
+            scene.load(ASSET_DIR + "FluidBeach.abc", true);
+        } else {
+            particleStream = std::make_unique<ParticleStreamReader>(particleStreamName);
         }
+        scene.allocateColliders(context);
+        particleSetParams.resize(std::max(scene.getParticleSetCount(), 1u));
 
         cubeLineMesh = rv::Mesh::createCubeLineMesh(context, {});
 
@@ -230,87 +513,375 @@ private:
         particleBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
             .memory = rv::MemoryUsage::DeviceHost,
-            .size = sizeof(glm::vec4) * scene.maxParticleCount,
+            .size = sizeof(glm::vec4) * std::max(scene.maxParticleCount, 1u),
         });
-
-        // Grid
-        bottomGridParticleCounts = context.createBuffer({
+        particleAttributeBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
-            .memory = rv::MemoryUsage::Device,
-            .size = sizeof(uint32_t) * numCells,
+            .memory = rv::MemoryUsage::DeviceHost,
+            .size = sizeof(glm::vec4) * std::max(scene.maxParticleCount, 1u),
         });
-        bottomGridParticleIndices = context.createBuffer({
+        sprayParticleBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
             .memory = rv::MemoryUsage::Device,
-            .size = sizeof(uint32_t) * numCells * maxParticlesPerCell,
+            .size = sizeof(uint32_t) * std::max(scene.maxParticleCount, 1u),
         });
-        topGridValidCellCounts = context.createBuffer({
+
+        // Counter
+        surfaceCountBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
             .memory = rv::MemoryUsage::Device,
-            .size = sizeof(uint32_t) * numBlocks,
+            .size = sizeof(uint32_t) * (7 + maxParticleSets),
         });
 
-        // Surface cell & particle & vertex
-        surfaceCellBuffer = context.createBuffer({
-            .usage = rv::BufferUsage::Storage,
+        // Indirect dispatch commands and the spray draw
+        uint32_t indirectDispatchCommandCount = 5;
+        indirectDispatchCommandBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Indirect,
             .memory = rv::MemoryUsage::Device,
-            .size = sizeof(uint32_t) * numCells,
+            .size = sizeof(glm::uvec4) * indirectDispatchCommandCount,
         });
-        surfaceVertexBuffer = context.createBuffer({
+
+        // Grid constants, a slot per tile of the frame
+        gridConstantBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
-            .memory = rv::MemoryUsage::Device,
-            .size = sizeof(uint32_t) * numVertices,
+            .memory = rv::MemoryUsage::Host,
+            .size = sizeof(GridConstants),
         });
-        compressedVertexBuffer = context.createBuffer({
+
+        // Statistics ring, one slot per frame
+        statisticsBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
-            .memory = rv::MemoryUsage::Device,
-            .size = sizeof(uint32_t) * numVertices,
+            .memory = rv::MemoryUsage::Host,
+            .size = sizeof(SurfaceStatistics) * statisticsRingSize,
         });
-        densityBuffer = context.createBuffer({
+        std::memset(statisticsBuffer->map(), 0, statisticsBuffer->getSize());
+
+        // Marching cubes tables, written once
+        marchingCubesTableBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
-            .memory = rv::MemoryUsage::Device,
-            .size = sizeof(float) * numVertices,
+            .memory = rv::MemoryUsage::DeviceHost,
+            .size = sizeof(MarchingCubesTables),
         });
+        *static_cast<MarchingCubesTables*>(marchingCubesTableBuffer->map()) = MarchingCubesTables{};
 
-        // Normal
-        cellVertexNormalBuffer = context.createBuffer({
+        // Placeholders until an offline batch is started
+        capturedMeshBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
-            .memory = rv::MemoryUsage::Device,
-            .size = sizeof(glm::vec4) * numVertices,
+            .memory = rv::MemoryUsage::Host,
+            .size = sizeof(CapturedVertex),
         });
-
-        // Counter
-        surfaceCountBuffer = context.createBuffer({
+        capturedCountBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
             .memory = rv::MemoryUsage::Host,
-            .size = sizeof(uint32_t) * 6,
+            .size = sizeof(uint32_t),
         });
 
-        // Surface block
-        surfaceBlockBuffer = context.createBuffer({
+        createLayerBuffers(static_cast<uint32_t>(particleSetParams.size()));
+    }
+
+    // The grid buffers hold one layer per particle set and motion sample.
+    // They are aliased by lifetime, which depends on the debug draws that read them.
+    // When the stages may be skipped, the inputs of the density stage are kept until the end
+    // of the frame, so that the next frame can run again from there.
+    void createLayerBuffers(uint32_t layerCount)
+    {
+        layerCapacity = layerCount;
+        plannedLifetimeFlags = getLifetimeFlags();
+        stageCacheValid = false;
+
+        using enum SurfaceStage;
+        transientArena = TransientArena{
+            std::vector<std::string>(surfaceStageNames.begin(), surfaceStageNames.end())};
+        transientHandles.clear();
+        auto keepForDensity = [&](SurfaceStage lastStage) {
+            return cachesStageOutputs() ? std::max(lastStage, Extract) : lastStage;
+        };
+        SurfaceStage densityEnd = showBottomGrid || showSurfaceVertex ? DebugDraw : Extract;
+        addTransientBuffer(bottomGridParticleCounts, "BottomGridParticleCounts",
+                           sizeof(uint32_t) * numCells * layerCount, BuildGrids,
+                           keepForDensity(Density));
+        addTransientBuffer(bottomGridParticleIndices, "BottomGridParticleIndices",
+                           sizeof(uint32_t) * uint64_t(numCells) * maxParticlesPerCell * layerCount,
+                           BuildGrids, keepForDensity(Density));
+        addTransientBuffer(cellParticleCountBuffer, "CellParticleCounts",
+                           sizeof(uint32_t) * numCells * layerCount, BuildGrids, BuildGrids);
+        addTransientBuffer(blockOccupancyBuffer, "BlockOccupancy",
+                           sizeof(glm::uvec2) * numBlocks * layerCount, BuildGrids, SurfaceCell);
+        // Also used by the ordered spray list and the ordered capture of the batches
+        addTransientBuffer(compactionOffsetBuffer, "CompactionOffsets",
+                           sizeof(uint32_t) * numBlocks * (KC / 32) * layerCount, BuildGrids,
+                           batchRunning ? Extract : CompressVertex);
+        addTransientBuffer(surfaceBlockBuffer, "SurfaceBlocks",
+                           sizeof(uint32_t) * numBlocks * layerCount, SurfaceBlock,
+                           showTopGrid ? DebugDraw : Extract);
+        addTransientBuffer(surfaceCellBuffer, "SurfaceCells",
+                           sizeof(uint32_t) * numCells * layerCount, SurfaceCell,
+                           showBottomGrid ? DebugDraw : SurfaceCell);
+        addTransientBuffer(blockVertexMaskBuffer, "BlockVertexMasks",
+                           sizeof(glm::uvec4) * numBlocks * layerCount, SurfaceCell,
+                           CompressVertex);
+        addTransientBuffer(compressedVertexBuffer, "CompressedVertices",
+                           sizeof(uint32_t) * numVertices * layerCount, CompressVertex,
+                           keepForDensity(showSurfaceVertex ? DebugDraw : Normal));
+        addTransientBuffer(densityBuffer, "Density", sizeof(float) * numVertices * layerCount,
+                           Density, densityEnd);
+        addTransientBuffer(cellVertexNormalBuffer, "CellVertexNormals",
+                           sizeof(glm::vec4) * numVertices * layerCount, Normal, Extract);
+        addTransientBuffer(vertexAttributeBuffer, "VertexAttributes",
+                           transferAttributes ? sizeof(glm::vec4) * numVertices * layerCount
+                                              : sizeof(glm::vec4),
+                           Density, Extract);
+        addTransientBuffer(blockLodBuffer, "BlockLods", sizeof(uint32_t) * numBlocks * layerCount,
+                           BlockLod, Extract);
+        transientArena.build();
+
+        std::vector<rv::BufferHandle> allocations;
+        for (uint32_t i = 0; i < transientArena.getAllocationCount(); i++) {
+            allocations.push_back(context.createBuffer({
+                .usage = rv::BufferUsage::Storage,
+                .memory = rv::MemoryUsage::Device,
+                .size = transientArena.getAllocationSize(i),
+            }));
+        }
+        for (uint32_t i = 0; i < transientArena.getBufferCount(); i++) {
+            *transientHandles[i] = allocations[transientArena.getAllocation(i)];
+        }
+
+        // Particle set parameters
+        particleSetBuffer = context.createBuffer({
             .usage = rv::BufferUsage::Storage,
-            .memory = rv::MemoryUsage::Device,
-            .size = sizeof(uint32_t) * numBlocks,
+            .memory = rv::MemoryUsage::Host,
+            .size = sizeof(ParticleSetParams) * layerCount,
         });
 
-        // Indirect dispatch command
-        uint32_t indirectDispatchCommandCount = 3;
-        indirectDispatchCommandBuffer = context.createBuffer({
-            .usage = rv::BufferUsage::Indirect,
+        spdlog::info("Grid buffers of {} layers", layerCount);
+        for (const std::string& line : transientArena.getReport()) {
+            spdlog::info(line);
+        }
+    }
+
+    void addTransientBuffer(rv::BufferHandle& handle,
+                            std::string name,
+                            uint64_t size,
+                            SurfaceStage firstStage,
+                            SurfaceStage lastStage)
+    {
+        transientArena.add(std::move(name), size, static_cast<uint32_t>(firstStage),
+                           static_cast<uint32_t>(lastStage));
+        transientHandles.push_back(&handle);
+    }
+
+    // Stage outputs are kept across frames only if the grid buffers are not shared by tiles
+    bool cachesStageOutputs() const { return skipUnchangedStages && !tiledMode && !batchRunning; }
+
+    // Debug draws, stage skipping and the batches, which extend the buffer lifetimes,
+    // and the attribute transfer, which sizes the vertex attributes
+    uint32_t getLifetimeFlags() const
+    {
+        return (showBottomGrid ? 1 : 0) | (showSurfaceVertex ? 2 : 0) | (showTopGrid ? 4 : 0)
+               | (cachesStageOutputs() ? 8 : 0) | (transferAttributes ? 16 : 0)
+               | (batchRunning ? 32 : 0);
+    }
+
+    // The first stage whose inputs changed since the last frame. The earlier stages are skipped
+    // and their outputs of the last frame are used.
+    //   BuildGrids to CompressVertex: particles, grid, kernel radius, spray classification and
+    //   compaction order
+    //   Density and Normal: kernel scale and storage format, iso value in unorm16 format,
+    //   particle attributes
+    //   BlockLod: camera while LOD is enabled
+    //   Extract: iso value and everything else, always run
+    SurfaceStage findFirstDirtyStage()
+    {
+        using enum SurfaceStage;
+        if (!cachesStageOutputs()) {
+            stageCacheValid = false;
+            return BuildGrids;
+        }
+
+        // The parameters as uploaded, which may be a frame behind the GUI
+        const auto* layerParams = static_cast<const ParticleSetParams*>(particleSetBuffer->map());
+        std::span<const ParticleSetParams> setParams{layerParams, gridConstants.particleSetCount};
+        std::span<const glm::vec4> particles = frameParticles;
+        if (particleStream) {
+            particles = particleStream->getFrame().particles;
+        }
+
+        bool particlesChanged = !std::ranges::equal(particles, stageInputs.particles);
+        bool radiusChanged = setParams.size() != stageInputs.particleSets.size();
+        bool scaleChanged = false;
+        bool isoChanged = false;
+        for (size_t i = 0; i < setParams.size() && !radiusChanged; i++) {
+            const ParticleSetParams& last = stageInputs.particleSets[i];
+            radiusChanged |= setParams[i].kernelRadius != last.kernelRadius;
+            scaleChanged |= setParams[i].kernelScale != last.kernelScale;
+            isoChanged |= setParams[i].isoValue != last.isoValue;
+        }
+        bool cameraChanged = pushConstants.viewProj != stageInputs.viewProj
+                             || pushConstants.resolution != stageInputs.resolution;
+        uint32_t densityFormat = gridConstants.storageFormat & densityFormatMask;
+
+        SurfaceStage stage = Extract;
+        if ((cameraChanged && gridConstants.lodCellPixels > 0.0f)
+            || gridConstants.lodCellPixels != stageInputs.lodCellPixels) {
+            stage = BlockLod;
+        }
+        bool attributesChanged = !std::ranges::equal(frameAttributes, stageInputs.attributes);
+        if (scaleChanged || gridConstants.storageFormat != stageInputs.storageFormat
+            || (isoChanged && densityFormat == densityUnorm16) || attributesChanged) {
+            stage = Density;
+        }
+        if (!stageCacheValid || particlesChanged || radiusChanged
+            || gridConstants.gridOrigin != stageInputs.gridOrigin
+            || gridConstants.sprayNeighborCount != stageInputs.sprayNeighborCount
+            || gridConstants.orderedCompaction != stageInputs.orderedCompaction) {
+            stage = BuildGrids;
+        }
+
+        if (particlesChanged) {
+            stageInputs.particles.assign(particles.begin(), particles.end());
+        }
+        if (attributesChanged) {
+            stageInputs.attributes = frameAttributes;
+        }
+        stageInputs.particleSets.assign(setParams.begin(), setParams.end());
+        stageInputs.gridOrigin = gridConstants.gridOrigin;
+        stageInputs.storageFormat = gridConstants.storageFormat;
+        stageInputs.viewProj = pushConstants.viewProj;
+        stageInputs.resolution = pushConstants.resolution;
+        stageInputs.lodCellPixels = gridConstants.lodCellPixels;
+        stageInputs.sprayNeighborCount = gridConstants.sprayNeighborCount;
+        stageInputs.orderedCompaction = gridConstants.orderedCompaction;
+        stageCacheValid = true;
+        return stage;
+    }
+
+    // Clear the buffers whose lifetime begins, after the previous users of their allocations.
+    // Returns false if the stage is skipped in this frame.
+    bool beginStage(const rv::CommandBufferHandle& commandBuffer, SurfaceStage stage)
+    {
+        if (stage < firstStage) {
+            return false;
+        }
+        std::vector<rv::BufferHandle> buffers;
+        for (uint32_t i : transientArena.getBuffersStartingAt(static_cast<uint32_t>(stage))) {
+            buffers.push_back(*transientHandles[i]);
+        }
+        if (buffers.empty()) {
+            return true;
+        }
+        commandBuffer->bufferBarrier(buffers,
+                                     vk::PipelineStageFlagBits::eAllCommands,  //
+                                     vk::PipelineStageFlagBits::eTransfer,     //
+                                     vk::AccessFlagBits::eShaderWrite,         //
+                                     vk::AccessFlagBits::eTransferWrite);
+        for (const auto& buffer : buffers) {
+            commandBuffer->fillBuffer(buffer, 0);
+        }
+        commandBuffer->bufferBarrier(buffers,
+                                     vk::PipelineStageFlagBits::eTransfer,       //
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::AccessFlagBits::eTransferWrite,         //
+                                     vk::AccessFlagBits::eShaderRead);
+        return true;
+    }
+
+    // Grow the layered buffers if more layers are requested,
+    // and plan them again if the lifetime flags change
+    void reserveLayers(uint32_t layerCount)
+    {
+        if (layerCount <= layerCapacity && getLifetimeFlags() == plannedLifetimeFlags) {
+            return;
+        }
+        context.getQueue().waitIdle();
+        createLayerBuffers(std::max(layerCount, layerCapacity));
+        descSet->set("BottomGridParticleCounts", bottomGridParticleCounts);
+        descSet->set("BottomGridParticleIndices", bottomGridParticleIndices);
+        descSet->set("CellParticleCounts", cellParticleCountBuffer);
+        descSet->set("BlockOccupancy", blockOccupancyBuffer);
+        descSet->set("CompactionOffsets", compactionOffsetBuffer);
+        descSet->set("SurfaceCells", surfaceCellBuffer);
+        descSet->set("BlockVertexMasks", blockVertexMaskBuffer);
+        descSet->set("CompressedVertices", compressedVertexBuffer);
+        descSet->set("Density", densityBuffer);
+        descSet->set("CellVertexNormals", cellVertexNormalBuffer);
+        descSet->set("VertexAttributes", vertexAttributeBuffer);
+        descSet->set("SurfaceBlocks", surfaceBlockBuffer);
+        descSet->set("BlockLods", blockLodBuffer);
+        descSet->set("ParticleSets", particleSetBuffer);
+        descSet->update();
+    }
+
+    // Every motion sample of a set uses the parameters of the set
+    void updateParticleSets(uint32_t layerCount)
+    {
+        // The tiling halo covers the largest kernel
+        gridConstants.particleSetCount = layerCount;
+        maxKernelRadius = 0.0f;
+        for (const auto& params : particleSetParams) {
+            maxKernelRadius = std::max(maxKernelRadius, params.kernelRadius);
+        }
+        auto* layerParams = static_cast<ParticleSetParams*>(particleSetBuffer->map());
+        for (uint32_t i = 0; i < layerCount; i++) {
+            layerParams[i] = particleSetParams[i % particleSetParams.size()];
+        }
+    }
+
+    // Grow the grid constant buffer to a slot per tile
+    void reserveGridSlots(uint64_t slotCount)
+    {
+        if (sizeof(GridConstants) * slotCount <= gridConstantBuffer->getSize()) {
+            return;
+        }
+        context.getQueue().waitIdle();
+        gridConstantBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Storage,
             .memory = rv::MemoryUsage::Host,
-            .size = sizeof(glm::uvec4) * indirectDispatchCommandCount,
+            .size = sizeof(GridConstants) * slotCount,
         });
+        descSet->set("GridConstantSlots", gridConstantBuffer);
+        descSet->update();
+    }
 
-        uint64_t memorySize = particleBuffer->getSize()               //
-                              + bottomGridParticleCounts->getSize()   //
-                              + bottomGridParticleIndices->getSize()  //
-                              + surfaceVertexBuffer->getSize()        //
-                              + compressedVertexBuffer->getSize()     //
-                              + densityBuffer->getSize()              //
-                              + cellVertexNormalBuffer->getSize()     //
-                              + topGridValidCellCounts->getSize()     //
-                              + surfaceBlockBuffer->getSize();
-        spdlog::info("Shared buffer size: {} MB", memorySize / 1024.0 / 1024.0);
+    // Write the grid constants to the slot read by the following passes. The slots are read
+    // when the command buffer executes, so each tile of a frame has its own.
+    void setGridSlot(uint32_t slot)
+    {
+        static_cast<GridConstants*>(gridConstantBuffer->map())[slot] = gridConstants;
+        pushConstants.gridSlot = slot;
+    }
+
+    // Grow the particle buffer if the particles of all tiles do not fit
+    void reserveParticleBuffer(uint64_t particleCount)
+    {
+        // The shaders index the particles with 32 bits
+        if (particleCount > UINT32_MAX) {
+            throw std::runtime_error{"Too many particles for 32-bit particle indices!"};
+        }
+        if (sizeof(glm::vec4) * particleCount <= particleBuffer->getSize()) {
+            return;
+        }
+        context.getQueue().waitIdle();
+        particleBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Storage,
+            .memory = rv::MemoryUsage::DeviceHost,
+            .size = sizeof(glm::vec4) * particleCount,
+        });
+        particleAttributeBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Storage,
+            .memory = rv::MemoryUsage::DeviceHost,
+            .size = sizeof(glm::vec4) * particleCount,
+        });
+        sprayParticleBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Storage,
+            .memory = rv::MemoryUsage::Device,
+            .size = sizeof(uint32_t) * particleCount,
+        });
+        descSet->set("ParticlePositions", particleBuffer);
+        descSet->set("ParticleAttributes", particleAttributeBuffer);
+        descSet->set("SprayParticles", sprayParticleBuffer);
+        descSet->update();
+        spdlog::info("Particle buffer size: {} MB", particleBuffer->getSize() / 1024.0 / 1024.0);
     }
 
     void createImages()
@@ -319,7 +890,8 @@ private:
         const uint32_t height = rv::Window::getHeight();
 
         depthImage = context.createImage({
-            .usage = rv::ImageUsage::DepthAttachment,
+            .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment |  //
+                     vk::ImageUsageFlagBits::eSampled,
             .extent = {rv::Window::getWidth(), rv::Window::getHeight(), 1},
             .format = depthFormat,
             .debugName = "depthImage",
@@ -352,6 +924,7 @@ private:
         });
 
         depthImage->createImageView(vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eDepth);
+        depthImage->createSampler();
         opaquePosImage->createImageView(vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eColor);
         opaqueColorImage->createImageView(vk::ImageViewType::e2D, vk::ImageAspectFlagBits::eColor);
         opaquePosImage->createSampler();
@@ -396,23 +969,40 @@ private:
             shaders.push_back(createShader(meshShaderPipeline.fragmentShaderInfo));
         }
 
+        // Hi-Z is shared with the culling task shader
+        hiZPass.init(context, depthImage, rv::Window::getWidth(), rv::Window::getHeight());
+
         // Create descriptor set
         descSet = context.createDescriptorSet({
             .shaders = shaders,
             .buffers = {{"ParticlePositions", particleBuffer},
+                        {"ParticleAttributes", particleAttributeBuffer},
                         // Counter
                         {"SurfaceCounts", surfaceCountBuffer},
                         // Surface cell & particle
                         {"SurfaceCells", surfaceCellBuffer},
-                        {"SurfaceVertices", surfaceVertexBuffer},
+                        {"BlockVertexMasks", blockVertexMaskBuffer},
                         {"CompressedVertices", compressedVertexBuffer},
                         {"Density", densityBuffer},
                         {"CellVertexNormals", cellVertexNormalBuffer},
+                        {"VertexAttributes", vertexAttributeBuffer},
                         {"DispatchIndirectCommands", indirectDispatchCommandBuffer},
+                        {"MarchingCubesTables", marchingCubesTableBuffer},
+                        {"Statistics", statisticsBuffer},
+                        {"CapturedMeshes", capturedMeshBuffer},
+                        {"CapturedCounts", capturedCountBuffer},
                         {"BottomGridParticleCounts", bottomGridParticleCounts},
                         {"BottomGridParticleIndices", bottomGridParticleIndices},
-                        {"TopGridValidCellCounts", topGridValidCellCounts},
+                        {"CellParticleCounts", cellParticleCountBuffer},
+                        {"BlockOccupancy", blockOccupancyBuffer},
+                        {"CompactionOffsets", compactionOffsetBuffer},
+                        {"SprayParticles", sprayParticleBuffer},
                         {"SurfaceBlocks", surfaceBlockBuffer},
+                        {"GridConstantSlots", gridConstantBuffer},
+                        {"BlockLods", blockLodBuffer},
+                        {"ParticleSets", particleSetBuffer},
+                        {"HiZ", hiZPass.getBuffer()},
+                        {"ColliderTransforms", scene.colliderTransformBuffer},
             },
             .images = {
                 {"envIrradianceImage", envIrradianceImage},
@@ -433,6 +1023,7 @@ private:
             .vertexAttributes = {{
                 {.offset = offsetof(Scene::Vertex, pos), .format = vk::Format::eR32G32B32Sfloat},
                 {.offset = offsetof(Scene::Vertex, normal), .format = vk::Format::eR32G32B32Sfloat},
+                {.offset = offsetof(Scene::Vertex, collider), .format = vk::Format::eR32Uint},
             }},
             .colorFormats = {
                 colorFormat,
@@ -453,6 +1044,17 @@ private:
             .polygonMode = vk::PolygonMode::ePoint,
         });
 
+        graphicsPipelines["Spray"].pipeline = context.createGraphicsPipeline({
+            .descSetLayout = descSet->getLayout(),
+            .pushSize = sizeof(PushConstants),
+            .vertexShader = shaders[graphicsPipelines["Spray"].vertexShaderInfo.shaderIndex],
+            .fragmentShader = shaders[graphicsPipelines["Spray"].fragmentShaderInfo.shaderIndex],
+            .colorFormats = {colorFormat},
+            .depthFormat = depthFormat,
+            .topology = vk::PrimitiveTopology::ePointList,
+            .polygonMode = vk::PolygonMode::ePoint,
+        });
+
         graphicsPipelines["SurfaceVertex"].pipeline = context.createGraphicsPipeline({
             .descSetLayout = descSet->getLayout(),
             .pushSize = sizeof(PushConstants),
@@ -503,18 +1105,22 @@ private:
             .lineWidth = "dynamic",
         });
 
-        meshShaderPipelines["SurfacePerBlock"].pipeline = context.createMeshShaderPipeline({
-            .descSetLayout = descSet->getLayout(),
-            .pushSize = sizeof(PushConstants),
-            .taskShader = {},
-            .meshShader
-            = shaders[meshShaderPipelines["SurfacePerBlock"].meshShaderInfo.shaderIndex],
-            .fragmentShader
-            = shaders[meshShaderPipelines["SurfacePerBlock"].fragmentShaderInfo.shaderIndex],
-            .colorFormats = {colorFormat},
-            .depthFormat = depthFormat,
-            .lineWidth = "dynamic",
-        });
+        for (auto& meshShaderPipeline : meshShaderPipelines | std::views::values) {
+            // The task shader is optional
+            const auto& taskShaderInfo = meshShaderPipeline.taskShaderInfo;
+            meshShaderPipeline.pipeline = context.createMeshShaderPipeline({
+                .descSetLayout = descSet->getLayout(),
+                .pushSize = sizeof(PushConstants),
+                .taskShader = taskShaderInfo.shaderIndex >= 0
+                                  ? shaders[taskShaderInfo.shaderIndex]
+                                  : rv::ShaderHandle{},
+                .meshShader = shaders[meshShaderPipeline.meshShaderInfo.shaderIndex],
+                .fragmentShader = shaders[meshShaderPipeline.fragmentShaderInfo.shaderIndex],
+                .colorFormats = {colorFormat},
+                .depthFormat = depthFormat,
+                .lineWidth = "dynamic",
+            });
+        }
         backgroundPass.init(context, envRadianceImage);
     }
 
@@ -528,14 +1134,24 @@ private:
                          FLT_MAX, FLT_MAX, {300, 150});
     }
 
+    // Statistics of the oldest frame in the ring. The frames after it may still be running,
+    // so reading it never waits for the GPU.
+    const SurfaceStatistics& getStatistics() const
+    {
+        auto* ring = static_cast<const SurfaceStatistics*>(statisticsBuffer->map());
+        return ring[(frame + 1) % statisticsRingSize];
+    }
+
     void displayComputedCounts() const
     {
         if (ImGui::TreeNode("Computed counts")) {
-            uint32_t* counts = static_cast<uint32_t*>(surfaceCountBuffer->map());
-            ImGui::Text("Surface cells: %d", counts[1]);
-            ImGui::Text("Surface particles: %d", counts[2]);
-            ImGui::Text("Surface vertices: %d", counts[3]);
-            ImGui::Text("Densities: %d", counts[4]);
+            const SurfaceStatistics& stats = getStatistics();
+            ImGui::Text("Surface blocks: %d", stats.surfaceBlockCount);
+            ImGui::Text("Surface cells: %d", stats.surfaceCellCount);
+            ImGui::Text("Surface particles: %d", stats.surfaceParticleCount);
+            ImGui::Text("Surface vertices: %d", stats.surfaceVertexCount);
+            ImGui::Text("Densities: %d", stats.densityCount);
+            ImGui::Text("Spray particles: %d", stats.sprayParticleCount);
             ImGui::TreePop();
         }
     }
@@ -543,47 +1159,78 @@ private:
     void displayDispatchCommandsInfo() const
     {
         if (ImGui::TreeNode("Dispatch commands")) {
-            auto dispatchCommands = static_cast<glm::uvec4*>(indirectDispatchCommandBuffer->map());
-            ImGui::Text("Dispatch[density]: %d", dispatchCommands[densityCommandIndex].x);
-            ImGui::Text("Dispatch[marchingCubes]: %d",
-                        dispatchCommands[marchingCubesCommandIndex].x);
-            ImGui::Text("Dispatch[surfaceCellWithBlock]: %d",
-                        dispatchCommands[surfaceCellWithBlockCommandIndex].x);
+            const SurfaceStatistics& stats = getStatistics();
+            ImGui::Text("Dispatch[density]: %d", stats.densityGroups);
+            ImGui::Text("Dispatch[marchingCubes]: %d", stats.marchingCubesGroups);
+            ImGui::Text("Dispatch[surfaceCellWithBlock]: %d", stats.surfaceCellWithBlockGroups);
+            ImGui::Text("Dispatch[surfaceBlock]: %d", stats.surfaceBlockGroups);
             ImGui::TreePop();
         }
     }
 
-    void renderSurface(const rv::CommandBufferHandle& commandBuffer)
+    // Timestamps around a compaction stage, which includes its count pass and scan if the
+    // compaction is ordered
+    template <typename Func>
+    void timeCompaction(const rv::CommandBufferHandle& commandBuffer,
+                        const rv::GPUTimerHandle& timer,
+                        Func&& compact)
+    {
+        commandBuffer->beginTimestamp(timer);
+        compact();
+        commandBuffer->endTimestamp(timer);
+    }
+
+    // Each tile writes its own timestamps and adds its counts to the statistics of the frame
+    void renderSurface(const rv::CommandBufferHandle& commandBuffer, const SurfaceTimers& timers)
     {
         // Compute
         {
-            commandBuffer->beginTimestamp(gpuTimers[0]);
-
-            commandBuffer->beginDebugLabel("BuildGrids");
-            fillTwoGrids(commandBuffer);  // changed
-            commandBuffer->endDebugLabel();
+            commandBuffer->beginTimestamp(timers.compute);
+
+            if (beginStage(commandBuffer, SurfaceStage::BuildGrids)) {
+                commandBuffer->beginDebugLabel("BuildGrids");
+                fillTwoGrids(commandBuffer);  // changed
+                commandBuffer->endDebugLabel();
+
+                commandBuffer->beginDebugLabel("DetectSurface");
+                beginStage(commandBuffer, SurfaceStage::SurfaceBlock);
+                timeCompaction(commandBuffer, timers.compaction[0],
+                               [&] { computeSurfaceBlock(commandBuffer); });  // added
+                beginStage(commandBuffer, SurfaceStage::SurfaceCell);
+                timeCompaction(commandBuffer, timers.compaction[1],
+                               [&] { computeSurfaceCell(commandBuffer); });  // changed
+                beginStage(commandBuffer, SurfaceStage::CompressVertex);
+                timeCompaction(commandBuffer, timers.compaction[2],
+                               [&] { compressSurfaceVertex(commandBuffer); });
+                commandBuffer->endDebugLabel();
+                compactionTimedMode = static_cast<int>(gridConstants.orderedCompaction);
+            }
 
-            commandBuffer->beginDebugLabel("DetectSurface");
-            computeSurfaceBlock(commandBuffer);  // added
-            computeSurfaceCell(commandBuffer);   // changed
-            compressSurfaceVertex(commandBuffer);
-            commandBuffer->endDebugLabel();
+            if (beginStage(commandBuffer, SurfaceStage::Density)) {
+                commandBuffer->beginDebugLabel("ComputeDensity");
+                computeDensity(commandBuffer);
+                beginStage(commandBuffer, SurfaceStage::Normal);
+                computeCellVertexNormal(commandBuffer);
+                commandBuffer->endDebugLabel();
+            }
 
-            commandBuffer->beginDebugLabel("ComputeDensity");
-            computeDensity(commandBuffer);
-            computeCellVertexNormal(commandBuffer);
-            commandBuffer->endDebugLabel();
+            // The LOD buffer is read by the extractor even if LOD is disabled
+            if (beginStage(commandBuffer, SurfaceStage::BlockLod)
+                && gridConstants.lodCellPixels > 0.0f) {
+                commandBuffer->beginDebugLabel("SelectLod");
+                computeBlockLod(commandBuffer);
+                commandBuffer->endDebugLabel();
+            }
 
-            commandBuffer->endTimestamp(gpuTimers[0]);
+            commandBuffer->endTimestamp(timers.compute);
+            copyStatistics(commandBuffer);
         }
 
         // Rendering
         {
             const uint32_t width = rv::Window::getWidth();
             const uint32_t height = rv::Window::getHeight();
-            displayComputedCounts();
-            displayDispatchCommandsInfo();
-            commandBuffer->beginTimestamp(gpuTimers[1]);
+            commandBuffer->beginTimestamp(timers.rendering);
             commandBuffer->beginDebugLabel("MC and Draw");
             commandBuffer->beginRendering(getCurrentColorImage(), depthImage, {0, 0},
                                           {width, height});
@@ -591,52 +1238,197 @@ private:
             commandBuffer->setScissor(width, height);
             commandBuffer->setLineWidth(lineWidth);
 
-            // Draw Surface
-            if (showSurface) {
-                commandBuffer->bindDescriptorSet(descSet,
-                                                 meshShaderPipelines["SurfacePerBlock"].pipeline);
-                commandBuffer->bindPipeline(meshShaderPipelines["SurfacePerBlock"].pipeline);
-                commandBuffer->pushConstants(meshShaderPipelines["SurfacePerBlock"].pipeline,
-                                             &pushConstants);
+            // Draw Surface, unless it is captured
+            if (showSurface && !isCapturing()) {
+                // Culled: one task workgroup per 32 surface blocks
+                // Otherwise: two mesh workgroups per surface block
+                std::string name
+                    = extractor == Extractor::SurfaceNets ? "SurfaceNets" : "SurfacePerBlock";
+                uint32_t commandIndex = surfaceCellWithBlockCommandIndex;
+                if (cullSurfaceBlocks) {
+                    name += "Culled";
+                    commandIndex = surfaceBlockCommandIndex;
+                }
+                const auto& pipeline = meshShaderPipelines[name].pipeline;
+                commandBuffer->bindDescriptorSet(descSet, pipeline);
+                commandBuffer->bindPipeline(pipeline);
+                commandBuffer->pushConstants(pipeline, &pushConstants);
                 commandBuffer->drawMeshTasksIndirect(
-                    indirectDispatchCommandBuffer,
-                    sizeof(glm::uvec4) * surfaceCellWithBlockCommandIndex, 1,
+                    indirectDispatchCommandBuffer, sizeof(glm::uvec4) * commandIndex, 1,
                     sizeof(vk::DrawMeshTasksIndirectCommandEXT));
             }
 
+            // Draw spray, which is not meshed
+            if (showSurface && gridConstants.sprayNeighborCount > 0) {
+                const auto& pipeline = graphicsPipelines["Spray"].pipeline;
+                commandBuffer->bindDescriptorSet(descSet, pipeline);
+                commandBuffer->bindPipeline(pipeline);
+                commandBuffer->pushConstants(pipeline, &pushConstants);
+                commandBuffer->drawIndirect(indirectDispatchCommandBuffer,
+                                            sizeof(glm::uvec4) * sprayDrawCommandIndex, 1,
+                                            sizeof(vk::DrawIndirectCommand));
+            }
+
             commandBuffer->endRendering();
             commandBuffer->endDebugLabel();
-            commandBuffer->endTimestamp(gpuTimers[1]);
+            commandBuffer->endTimestamp(timers.rendering);
         }
     }
 
     void renderGUI()
     {
-        // Parameters
-        ImGui::SliderFloat("Kernel radius", &pushConstants.kernelRadius, 0.05f, 0.2f);
-        ImGui::SliderFloat("Kernel scale", &pushConstants.kernelScale, 0.05f, 20.0f);
-        ImGui::SliderFloat("Iso value", &pushConstants.isoValue, 0.001f, 0.1f);
+        // Parameters of each particle set
+        for (size_t i = 0; i < particleSetParams.size(); i++) {
+            auto& params = particleSetParams[i];
+            ImGui::PushID(static_cast<int>(i));
+            if (particleSetParams.size() > 1) {
+                ImGui::Text("%s", scene.particleSets[i].name.c_str());
+            }
+            ImGui::SliderFloat("Kernel radius", &params.kernelRadius, 0.05f, 0.2f);
+            ImGui::SliderFloat("Kernel scale", &params.kernelScale, 0.05f, 20.0f);
+            ImGui::SliderFloat("Iso value", &params.isoValue, 0.001f, 0.1f);
+            ImGui::PopID();
+        }
+
+        // Particles with fewer neighbors are drawn as points instead of being meshed
+        ImGui::SliderInt("Spray neighbors",
+                         reinterpret_cast<int*>(&gridConstants.sprayNeighborCount), 0, 16);
+
+        // Velocity and foam of the particles, averaged onto the surface in the density pass
+        if (particleStream || !scene.hasParticleAttributes()) {
+            ImGui::Text("No particle attributes");
+        } else {
+            ImGui::Checkbox("Particle attributes", &transferAttributes);
+        }
+        if (!transferAttributes) {
+            // The vertex attributes are shrunk before the next upload
+            gridConstants.transferAttributes = 0;
+        }
 
         // Frame
-        ImGui::SliderInt("Scene frame", &scene.frame, 0, scene.frameCount - 1);
+        if (particleStream) {
+            const StreamFrame& streamFrame = particleStream->getFrame();
+            ImGui::Text("Stream frame: %llu (time: %.3f)",
+                        static_cast<unsigned long long>(streamFrame.index), streamFrame.time);
+            ImGui::Text("Dropped frames: %llu",
+                        static_cast<unsigned long long>(particleStream->getDroppedFrameCount()));
+        }
+        ImGui::SliderFloat("Scene time", &scene.time, 0.0f,
+                           static_cast<float>(std::max(scene.frameCount - 1, 0)));
+        ImGui::SliderFloat("Playback speed", &scene.playbackSpeed, 0.05f, 1.0f);
+
+        // Motion samples are spread over the shutter interval in frames
+        const int setCount = static_cast<int>(particleSetParams.size());
+        ImGui::SliderInt("Motion samples", &motionSamples, 1,
+                         static_cast<int>(maxParticleSets) / setCount);
+        ImGui::SliderFloat("Shutter", &shutter, 0.0f, 1.0f);
 
         // Physics
         ImGui::Checkbox("Run physics", &runPhysics);
 
         if (frame > 0) {
-            float computeTime = gpuTimers[0]->elapsedInMilli();
-            float renderingTime = gpuTimers[1]->elapsedInMilli();
-            float frameTime = computeTime + renderingTime;
-
-            ImGui::Text("Frame time: %.3f ms", frameTime);
+            SurfaceTimes surfaceTimes = getSurfaceTimes();
+            float frameTime = surfaceTimes.compute + surfaceTimes.rendering;
+
+            if (timedTileCount > 1) {
+                ImGui::Text("Frame time (%d tiles): %.3f ms", static_cast<int>(timedTileCount),
+                            frameTime);
+            } else {
+                ImGui::Text("Frame time: %.3f ms", frameTime);
+            }
+            ImGui::Text("Compute: %.3f ms, rendering: %.3f ms", surfaceTimes.compute,
+                        surfaceTimes.rendering);
+            ImGui::Text("Compaction: blocks %.3f ms, cells %.3f ms, vertices %.3f ms",
+                        surfaceTimes.compaction[0], surfaceTimes.compaction[1],
+                        surfaceTimes.compaction[2]);
             showTimeline(frameTime);
         }
 
+        // Stages whose inputs did not change keep their outputs of the last frame
+        ImGui::Checkbox("Skip unchanged stages", &skipUnchangedStages);
+
+        // Compaction in block order, for identical outputs on identical inputs
+        bool orderedCompaction = gridConstants.orderedCompaction != 0;
+        ImGui::Checkbox("Ordered compaction", &orderedCompaction);
+        gridConstants.orderedCompaction = orderedCompaction ? 1 : 0;
+        if (compactionBenchmarkFrames == 0 && ImGui::Button("Benchmark compaction")) {
+            startCompactionBenchmark(100);
+        }
+        ImGui::Text("First stage run: %s", surfaceStageNames[static_cast<size_t>(firstStage)]);
+
+        // Statistics from statisticsRingSize - 1 frames ago, summed over the tiles in tiled mode
+        if (frame + 1 >= static_cast<int>(statisticsRingSize)) {
+            displayComputedCounts();
+            displayDispatchCommandsInfo();
+        }
+
+        // Grid fitted to the particles of each frame
+        if (ImGui::TreeNode("Domain")) {
+            ImGui::Checkbox("Fit to particles", &autoDomain);
+            if (tiledMode) {
+                ImGui::Text("Tiled mode uses the whole area");
+            }
+            ImGui::Text("Origin: %.3f, %.3f, %.3f", gridConstants.gridOrigin.x,
+                        gridConstants.gridOrigin.y, gridConstants.gridOrigin.z);
+            ImGui::Text("Cell size: %.4f", gridConstants.gridOrigin.w);
+            ImGui::TreePop();
+        }
+
+        // Tiled mode
+        if (ImGui::TreeNode("Tiled mode")) {
+            ImGui::Checkbox("Enable", &tiledMode);
+            ImGui::SliderInt("Resolution", &tileResolution, N, 1024);
+            tileResolution = tileResolution / K * K;
+            if (tiledMode) {
+                ImGui::Text("Tiles: %d^3 (halo: %d blocks)", tilePlan.tilesPerAxis,
+                            tilePlan.haloBlocks);
+                ImGui::Text("Tile particles: %zu", tileParticles.size());
+            }
+            ImGui::TreePop();
+        }
+
+        // Offline batches of consecutive frames, one pass per batch
+        if (ImGui::TreeNode("Offline batch")) {
+            ImGui::SliderInt("Frames per pass", &batchFrameCount, 1, 8);
+            if (tiledMode || particleStream) {
+                ImGui::Text("Not available in tiled mode or with a particle stream");
+            } else if (!batchRunning && ImGui::Button("Run")) {
+                startBatch();
+            } else if (batchRunning && ImGui::Button("Stop")) {
+                // The passes in flight are still read
+                batchNextFrame = static_cast<uint32_t>(scene.frameCount);
+            }
+            if (batchFrames > 0) {
+                ImGui::Text("Frames: %d / %d", batchFrames, scene.frameCount);
+                ImGui::Text("Frames/s: %.2f", batchFrames / (batchTime / 1000.0f));
+                ImGui::Text("Triangles: %llu",
+                            static_cast<unsigned long long>(batchTriangleCount));
+                ImGui::Text("Truncated meshes: %d", batchTruncatedMeshes);
+            }
+            ImGui::TreePop();
+        }
+
+        // CPU reference of the current frame
+        if (ImGui::TreeNode("CPU extraction")) {
+            if (ImGui::Button("Run")) {
+                runCpuExtraction();
+            }
+            if (cpuReconstructor) {
+                ImGui::Text("Time: %.3f ms", cpuTime);
+                ImGui::Text("Surface blocks: %zu", cpuSurfaceBlockCount);
+                ImGui::Text("Surface cells: %zu", cpuSurfaceCellCount);
+                ImGui::Text("Vertices: %zu", cpuMesh.positions.size());
+                ImGui::Text("Triangles: %zu", cpuMesh.getTriangleCount());
+            }
+            ImGui::TreePop();
+        }
+
         // Recompile shaders
         if (ImGui::Button("Recompile")) {
             try {
                 rv::CPUTimer timer;
                 createPipelines();
+                stageCacheValid = false;
                 spdlog::info("Recreate: {}ms", timer.elapsedInMilli());
             } catch (const std::exception& e) {
                 spdlog::error(e.what());
@@ -655,11 +1447,77 @@ private:
             ImGui::Checkbox("Draw top grid", &showTopGrid);
             ImGui::Checkbox("Draw surface", &showSurface);
             ImGui::Checkbox("Draw line", &surfaceDrawLine);
+            ImGui::SliderFloat("LOD cell pixels", &gridConstants.lodCellPixels, 0.0f, 16.0f);
+            ImGui::Checkbox("Cull surface blocks", &cullSurfaceBlocks);
+            ImGui::Combo("Extractor", reinterpret_cast<int*>(&extractor),
+                         "Marching cubes\0Surface nets\0");
+
+            // Compare the formats with --compare-storage
+            int densityFormat = static_cast<int>(gridConstants.storageFormat & densityFormatMask);
+            bool packNormals = (gridConstants.storageFormat & octahedralNormals) != 0;
+            ImGui::Combo("Density storage", &densityFormat, "Float32\0Float16\0Unorm16\0");
+            ImGui::Checkbox("Octahedral normals", &packNormals);
+            gridConstants.storageFormat
+                = static_cast<uint32_t>(densityFormat) | (packNormals ? octahedralNormals : 0);
 
             ImGui::TreePop();
         }
     }
 
+    // Same pipeline and extractor as the GPU, for the particles of the current frame.
+    // The sets are processed one after another and merged into a single mesh.
+    void runCpuExtraction()
+    {
+        if (!cpuReconstructor) {
+            cpuReconstructor = std::make_unique<Reconstructor>();
+        }
+        ReconstructionParams params;
+        params.extractor = extractor;
+        params.storageFormat = gridConstants.storageFormat;
+        params.sprayNeighborCount = gridConstants.sprayNeighborCount;
+        params.orderedCompaction = gridConstants.orderedCompaction != 0;
+        if (autoDomain && !tiledMode) {
+            params.gridOrigin = gridConstants.gridOrigin;
+        }
+
+        rv::CPUTimer timer;
+        cpuMesh = {};
+        cpuSurfaceBlockCount = 0;
+        cpuSurfaceCellCount = 0;
+        uint32_t setCount = particleStream ? 1 : scene.getParticleSetCount();
+        for (uint32_t i = 0; i < setCount; i++) {
+            params.isoValue = particleSetParams[i].isoValue;
+            params.kernelRadius = particleSetParams[i].kernelRadius;
+            params.kernelScale = particleSetParams[i].kernelScale;
+            std::vector<glm::vec4> particles;
+            std::vector<glm::vec4> attributes;
+            if (particleStream) {
+                cpuReconstructor->setParticles(particleStream->getFrame().particles);
+            } else {
+                scene.particleSets[i].appendParticles(scene.time, i, particles,
+                                                      transferAttributes ? &attributes : nullptr);
+                cpuReconstructor->setParticles(particles, attributes);
+            }
+            cpuReconstructor->setParams(params);
+            const Reconstruction& reconstruction = cpuReconstructor->reconstruct();
+            cpuSurfaceBlockCount += reconstruction.surfaceBlockCount;
+            cpuSurfaceCellCount += reconstruction.surfaceCellCount;
+
+            const SurfaceMesh& mesh = reconstruction.mesh;
+            uint32_t baseVertex = static_cast<uint32_t>(cpuMesh.positions.size());
+            cpuMesh.positions.insert(cpuMesh.positions.end(), mesh.positions.begin(),
+                                     mesh.positions.end());
+            cpuMesh.normals.insert(cpuMesh.normals.end(), mesh.normals.begin(),
+                                   mesh.normals.end());
+            cpuMesh.attributes.insert(cpuMesh.attributes.end(), mesh.attributes.begin(),
+                                      mesh.attributes.end());
+            for (uint32_t index : mesh.indices) {
+                cpuMesh.indices.push_back(baseVertex + index);
+            }
+        }
+        cpuTime = timer.elapsedInMilli();
+    }
+
     void dispatch(const rv::CommandBufferHandle& commandBuffer,
                   const std::string& name,
                   uint32_t x,
@@ -673,6 +1531,18 @@ private:
         commandBuffer->dispatch(x, y, z);
     }
 
+    void dispatchIndirect(const rv::CommandBufferHandle& commandBuffer,
+                          const std::string& name,
+                          uint32_t commandIndex)
+    {
+        const auto& pipeline = computePipelines[name].pipeline;
+        commandBuffer->bindDescriptorSet(descSet, pipeline);
+        commandBuffer->bindPipeline(pipeline);
+        commandBuffer->pushConstants(pipeline, &pushConstants);
+        commandBuffer->dispatchIndirect(indirectDispatchCommandBuffer,
+                                        sizeof(glm::uvec4) * commandIndex);
+    }
+
     void draw(const rv::CommandBufferHandle& commandBuffer,
               const std::string& name,
               uint32_t vertexCount)
@@ -688,23 +1558,49 @@ private:
 
     void fillTwoGrids(const rv::CommandBufferHandle& commandBuffer)
     {
+        // The spray is classified from the particle counts of the cells around each particle
+        bool classifySpray = gridConstants.sprayNeighborCount > 0;
+        if (classifySpray) {
+            dispatch(commandBuffer, "CountParticles", divRoundUp(numParticles, 32), 1, 1);
+            commandBuffer->bufferBarrier(cellParticleCountBuffer,
+                                         vk::PipelineStageFlagBits::eComputeShader,  //
+                                         vk::PipelineStageFlagBits::eComputeShader,  //
+                                         vk::AccessFlagBits::eShaderWrite,           //
+                                         vk::AccessFlagBits::eShaderRead);
+        }
         dispatch(commandBuffer, "FillTwoGrids", divRoundUp(numParticles, 32), 1, 1);
         commandBuffer->bufferBarrier(
-            {bottomGridParticleCounts, bottomGridParticleIndices, topGridValidCellCounts},
+            {bottomGridParticleCounts, bottomGridParticleIndices, blockOccupancyBuffer},
             vk::PipelineStageFlagBits::eComputeShader,  //
             vk::PipelineStageFlagBits::eComputeShader,  //
             vk::AccessFlagBits::eShaderWrite,           //
             vk::AccessFlagBits::eShaderRead);
+
+        // The ordered spray list is compacted in the order of the particles afterwards
+        if (classifySpray && gridConstants.orderedCompaction != 0) {
+            dispatch(commandBuffer, "CountSprayParticles", divRoundUp(sprayRangeCount, 32), 1, 1);
+            scanCompaction(commandBuffer, "ScanSprayParticles");
+            dispatch(commandBuffer, "ScatterSprayParticles", divRoundUp(sprayRangeCount, 32), 1,
+                     1);
+        }
+        if (classifySpray) {
+            commandBuffer->bufferBarrier(sprayParticleBuffer,
+                                         vk::PipelineStageFlagBits::eComputeShader,  //
+                                         vk::PipelineStageFlagBits::eVertexShader,   //
+                                         vk::AccessFlagBits::eShaderWrite,           //
+                                         vk::AccessFlagBits::eShaderRead);
+        }
     }
 
-    void computeSurfaceBlock(const rv::CommandBufferHandle& commandBuffer)
+    // The indirect arguments are written once from the counters after each compaction stage
+    void writeDispatchArgs(const rv::CommandBufferHandle& commandBuffer)
     {
-        dispatch(commandBuffer, "SurfaceBlock", divRoundUp(numBlocks, 32), 1, 1);
-        commandBuffer->bufferBarrier(surfaceBlockBuffer,
+        commandBuffer->bufferBarrier(surfaceCountBuffer,
                                      vk::PipelineStageFlagBits::eComputeShader,  //
                                      vk::PipelineStageFlagBits::eComputeShader,  //
                                      vk::AccessFlagBits::eShaderWrite,           //
                                      vk::AccessFlagBits::eShaderRead);
+        dispatch(commandBuffer, "DispatchArgs", 1, 1, 1);
         commandBuffer->bufferBarrier(indirectDispatchCommandBuffer,
                                      vk::PipelineStageFlagBits::eComputeShader,  //
                                      vk::PipelineStageFlagBits::eDrawIndirect,   //
@@ -712,35 +1608,96 @@ private:
                                      vk::AccessFlagBits::eIndirectCommandRead);
     }
 
+    void copyStatistics(const rv::CommandBufferHandle& commandBuffer)
+    {
+        commandBuffer->bufferBarrier({surfaceCountBuffer, indirectDispatchCommandBuffer},
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::AccessFlagBits::eShaderWrite,           //
+                                     vk::AccessFlagBits::eShaderRead);
+        dispatch(commandBuffer, "CopyStatistics", 1, 1, 1);
+
+        // The next tile adds to the statistics
+        commandBuffer->bufferBarrier(
+            statisticsBuffer,
+            vk::PipelineStageFlagBits::eComputeShader,  //
+            vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eHost,  //
+            vk::AccessFlagBits::eShaderWrite,                                              //
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eHostRead);
+    }
+
+    // Scan of the item counts of the ordered compaction, after the count pass of the stage
+    void scanCompaction(const rv::CommandBufferHandle& commandBuffer, const std::string& name)
+    {
+        commandBuffer->bufferBarrier(compactionOffsetBuffer,
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::AccessFlagBits::eShaderWrite,           //
+                                     vk::AccessFlagBits::eShaderRead);
+        dispatch(commandBuffer, name, 1, 1, 1);
+        commandBuffer->bufferBarrier({compactionOffsetBuffer, surfaceCountBuffer},
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::AccessFlagBits::eShaderWrite,           //
+                                     vk::AccessFlagBits::eShaderRead);
+    }
+
+    void computeSurfaceBlock(const rv::CommandBufferHandle& commandBuffer)
+    {
+        if (gridConstants.orderedCompaction != 0) {
+            dispatch(commandBuffer, "CountSurfaceBlocks",
+                     divRoundUp(numBlocks * gridConstants.particleSetCount, 32), 1, 1);
+            scanCompaction(commandBuffer, "ScanSurfaceBlocks");
+        }
+        dispatch(commandBuffer, "SurfaceBlock",
+                 divRoundUp(numBlocks * gridConstants.particleSetCount, 32), 1, 1);
+        commandBuffer->bufferBarrier(surfaceBlockBuffer,
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::AccessFlagBits::eShaderWrite,           //
+                                     vk::AccessFlagBits::eShaderRead);
+        writeDispatchArgs(commandBuffer);
+    }
+
     void computeSurfaceCell(const rv::CommandBufferHandle& commandBuffer)
     {
+        if (gridConstants.orderedCompaction != 0) {
+            dispatchIndirect(commandBuffer, "CountSurfaceCells", surfaceCellWithBlockCommandIndex);
+            scanCompaction(commandBuffer, "ScanSurfaceCells");
+        }
         auto& pipeline = computePipelines.at("SurfaceCell").pipeline;
         commandBuffer->bindDescriptorSet(descSet, pipeline);
         commandBuffer->bindPipeline(pipeline);
         commandBuffer->pushConstants(pipeline, &pushConstants);
         commandBuffer->dispatchIndirect(indirectDispatchCommandBuffer,
                                         sizeof(glm::uvec4) * surfaceCellWithBlockCommandIndex);
-
-        commandBuffer->bufferBarrier(indirectDispatchCommandBuffer,
+        commandBuffer->bufferBarrier({surfaceCellBuffer, blockVertexMaskBuffer},
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
                                      vk::PipelineStageFlagBits::eComputeShader,  //
-                                     vk::PipelineStageFlagBits::eDrawIndirect,   //
                                      vk::AccessFlagBits::eShaderWrite,           //
-                                     vk::AccessFlagBits::eIndirectCommandRead);
+                                     vk::AccessFlagBits::eShaderRead);
+        writeDispatchArgs(commandBuffer);
     }
 
+    // One invocation per surface block, from the vertex masks written by computeSurfaceCell()
     void compressSurfaceVertex(const rv::CommandBufferHandle& commandBuffer)
     {
-        dispatch(commandBuffer, "CompressVertex", divRoundUp(numVertices, 32), 1, 1);
+        if (gridConstants.orderedCompaction != 0) {
+            dispatchIndirect(commandBuffer, "CountSurfaceVertices", surfaceBlockCommandIndex);
+            scanCompaction(commandBuffer, "ScanSurfaceVertices");
+        }
+        auto& pipeline = computePipelines.at("CompressVertex").pipeline;
+        commandBuffer->bindDescriptorSet(descSet, pipeline);
+        commandBuffer->bindPipeline(pipeline);
+        commandBuffer->pushConstants(pipeline, &pushConstants);
+        commandBuffer->dispatchIndirect(indirectDispatchCommandBuffer,
+                                        sizeof(glm::uvec4) * surfaceBlockCommandIndex);
         commandBuffer->bufferBarrier({surfaceCountBuffer, compressedVertexBuffer},
                                      vk::PipelineStageFlagBits::eComputeShader,  //
                                      vk::PipelineStageFlagBits::eComputeShader,  //
                                      vk::AccessFlagBits::eShaderWrite,           //
                                      vk::AccessFlagBits::eShaderRead);
-        commandBuffer->bufferBarrier(indirectDispatchCommandBuffer,
-                                     vk::PipelineStageFlagBits::eComputeShader,  //
-                                     vk::PipelineStageFlagBits::eDrawIndirect,   //
-                                     vk::AccessFlagBits::eShaderWrite,           //
-                                     vk::AccessFlagBits::eIndirectCommandRead);
+        writeDispatchArgs(commandBuffer);
     }
 
     void computeDensity(const rv::CommandBufferHandle& commandBuffer)
@@ -773,6 +1730,229 @@ private:
                                      vk::AccessFlagBits::eShaderRead);
     }
 
+    void computeBlockLod(const rv::CommandBufferHandle& commandBuffer)
+    {
+        auto& pipeline = computePipelines.at("BlockLod").pipeline;
+        commandBuffer->bindDescriptorSet(descSet, pipeline);
+        commandBuffer->bindPipeline(pipeline);
+        commandBuffer->pushConstants(pipeline, &pushConstants);
+        commandBuffer->dispatchIndirect(indirectDispatchCommandBuffer,
+                                        sizeof(glm::uvec4) * surfaceBlockCommandIndex);
+        commandBuffer->bufferBarrier(blockLodBuffer,
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::PipelineStageFlagBits::eMeshShaderEXT,  //
+                                     vk::AccessFlagBits::eShaderWrite,           //
+                                     vk::AccessFlagBits::eShaderRead);
+    }
+
+    // The captured meshes and their counts are read by the host when the slot of the pass is
+    // reused, in advanceBatch()
+    void captureMeshes(const rv::CommandBufferHandle& commandBuffer)
+    {
+        commandBuffer->beginDebugLabel("CaptureMesh");
+        if (gridConstants.orderedCompaction != 0) {
+            dispatchIndirect(commandBuffer, "CountCapturedVertices",
+                             surfaceCellWithBlockCommandIndex);
+            scanCompaction(commandBuffer, "ScanCapturedVertices");
+        }
+        dispatchIndirect(commandBuffer, "CaptureMesh", surfaceCellWithBlockCommandIndex);
+        commandBuffer->bufferBarrier(surfaceCountBuffer,
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::AccessFlagBits::eShaderWrite,           //
+                                     vk::AccessFlagBits::eShaderRead);
+        dispatch(commandBuffer, "CopyCapturedCounts", 1, 1, 1);
+        commandBuffer->bufferBarrier({capturedMeshBuffer, capturedCountBuffer},
+                                     vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::PipelineStageFlagBits::eHost,           //
+                                     vk::AccessFlagBits::eShaderWrite,           //
+                                     vk::AccessFlagBits::eHostRead);
+        commandBuffer->endDebugLabel();
+    }
+
+    // Add the timers of the last frame, which has completed, and select the mode of the next
+    void advanceCompactionBenchmark()
+    {
+        if (compactionTimedMode == static_cast<int>(compactionBenchmarkMode)) {
+            SurfaceTimes surfaceTimes = getSurfaceTimes();
+            for (size_t i = 0; i < surfaceTimes.compaction.size(); i++) {
+                compactionBenchmarkTimes[i] += surfaceTimes.compaction[i];
+            }
+            compactionBenchmarkSamples++;
+        }
+        if (compactionBenchmarkSamples == compactionBenchmarkFrames) {
+            const auto& times = compactionBenchmarkTimes;
+            double samples = compactionBenchmarkSamples;
+            spdlog::info("{} compaction on the GPU: blocks {:.3f} ms, cells {:.3f} ms, "
+                         "vertices {:.3f} ms, total {:.3f} ms/frame",
+                         compactionBenchmarkMode != 0 ? "ordered" : "atomic", times[0] / samples,
+                         times[1] / samples, times[2] / samples,
+                         (times[0] + times[1] + times[2]) / samples);
+            if (compactionBenchmarkMode != 0) {
+                compactionBenchmarkFrames = 0;
+                gridConstants.orderedCompaction = compactionBenchmarkRestoredMode;
+                return;
+            }
+            compactionBenchmarkMode = 1;
+            compactionBenchmarkSamples = 0;
+            compactionBenchmarkTimes = {};
+        }
+        gridConstants.orderedCompaction = compactionBenchmarkMode;
+        stageCacheValid = false;
+    }
+
+    // Load the particles of the frames of the pass recorded in this frame into the slots of the
+    // pass, scene.maxParticleCount apart, and fit the grid to each frame
+    void uploadBatchPass(bool withAttributes)
+    {
+        BatchPass& pass = batchPasses[batchRingIndex];
+        auto* particles = static_cast<glm::vec4*>(particleBuffer->map());
+        auto* attributes = static_cast<glm::vec4*>(particleAttributeBuffer->map());
+        numParticles = 0;
+        for (uint32_t i = 0; i < pass.frames.size(); i++) {
+            frameParticles.clear();
+            frameAttributes.clear();
+            scene.appendParticles(static_cast<float>(pass.firstFrame + i), 0, frameParticles,
+                                  withAttributes ? &frameAttributes : nullptr);
+            BatchFrame& batchFrame = pass.frames[i];
+            batchFrame.particleCount = static_cast<uint32_t>(frameParticles.size());
+            batchFrame.gridOrigin = glm::vec4{areaOrigin, cellSize.x};
+            if (autoDomain) {
+                ParticleBounds bounds =
+                    computeParticleBounds(frameParticles.data(), batchFrame.particleCount,
+                                          std::thread::hardware_concurrency());
+                batchFrame.gridOrigin = fitGridToBounds(bounds, maxKernelRadius);
+            }
+
+            uint64_t offset =
+                uint64_t(batchRingIndex * batchPassCapacity + i) * scene.maxParticleCount;
+            std::memcpy(particles + offset, frameParticles.data(),
+                        sizeof(glm::vec4) * frameParticles.size());
+            if (withAttributes) {
+                std::memcpy(attributes + offset, frameAttributes.data(),
+                            sizeof(glm::vec4) * frameAttributes.size());
+            }
+            numParticles = std::max(numParticles, batchFrame.particleCount);
+        }
+    }
+
+    // Hand the meshes of the pass recorded batchRingSize frames ago, which has completed, to the
+    // consumer, and set up the next pass in its slot. Only the last passes are waited for.
+    void advanceBatch()
+    {
+        const uint32_t setCount = static_cast<uint32_t>(particleSetParams.size());
+        if (batchPassCapacity == 0) {
+            // The frames before the batch used the first slots
+            context.getQueue().waitIdle();
+            batchPassCapacity = static_cast<uint32_t>(batchFrameCount);
+            uint32_t slotCount = batchRingSize * batchPassCapacity;
+            reserveGridSlots(slotCount);
+            reserveSurfaceTimers(slotCount);
+            reserveParticleBuffer(uint64_t(slotCount) * scene.maxParticleCount);
+            reserveCaptureBuffer(slotCount * setCount);
+            timedTileCount = 0;
+        }
+
+        batchRingIndex = (batchRingIndex + 1) % batchRingSize;
+        readBatchPass(batchRingIndex);
+
+        int remainingFrames = tiledMode || particleStream
+                                  ? 0
+                                  : scene.frameCount - static_cast<int>(batchNextFrame);
+        if (remainingFrames > 0) {
+            BatchPass& pass = batchPasses[batchRingIndex];
+            pass.firstFrame = batchNextFrame;
+            pass.frames.resize(std::min(batchPassCapacity, static_cast<uint32_t>(remainingFrames)));
+            batchNextFrame += static_cast<uint32_t>(pass.frames.size());
+            return;
+        }
+
+        // The passes still in flight, oldest first
+        context.getQueue().waitIdle();
+        for (uint32_t i = 1; i < batchRingSize; i++) {
+            readBatchPass((batchRingIndex + i) % batchRingSize);
+        }
+        spdlog::info("Offline batch: {} frames in {:.1f} ms ({:.2f} frames/s), {} triangles",
+                     batchFrames, batchTime, batchFrames / (batchTime / 1000.0f),
+                     batchTriangleCount);
+        if (batchTruncatedMeshes > 0) {
+            spdlog::warn("Offline batch: {} meshes exceeded {} triangles", batchTruncatedMeshes,
+                         maxCapturedTriangles);
+        }
+        batchRunning = false;
+    }
+
+    // Hand the meshes of a completed pass to the consumer and free its slot
+    void readBatchPass(uint32_t ringIndex)
+    {
+        BatchPass& pass = batchPasses[ringIndex];
+        if (pass.frames.empty()) {
+            return;
+        }
+        const uint32_t setCount = static_cast<uint32_t>(particleSetParams.size());
+        const auto* counts = static_cast<const uint32_t*>(capturedCountBuffer->map());
+        for (uint32_t i = 0; i < pass.frames.size(); i++) {
+            uint32_t slot = ringIndex * batchPassCapacity + i;
+            for (uint32_t set = 0; set < setCount; set++) {
+                uint32_t region = slot * setCount + set;
+                std::span<const CapturedVertex> vertices = getCapturedMesh(region);
+                batchTriangleCount += vertices.size() / 3;
+                batchTruncatedMeshes += counts[region] > vertices.size() ? 1 : 0;
+                if (capturedMeshConsumer) {
+                    capturedMeshConsumer(static_cast<int>(pass.firstFrame + i), set, vertices);
+                }
+            }
+        }
+        batchFrames += static_cast<int>(pass.frames.size());
+        batchTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now()
+                                                             - batchStartTime)
+                        .count();
+
+        // The timers of the pass have completed as well
+        timedTileOffset = ringIndex * batchPassCapacity;
+        timedTileCount = pass.frames.size();
+        pass.frames.clear();
+    }
+
+    bool isCapturing() const
+    {
+        return batchRunning && !batchPasses[batchRingIndex].frames.empty();
+    }
+
+    // Triangle list of a region of the capture buffer, in place
+    std::span<const CapturedVertex> getCapturedMesh(uint32_t region) const
+    {
+        const auto* counts = static_cast<const uint32_t*>(capturedCountBuffer->map());
+        const auto* vertices = static_cast<const CapturedVertex*>(capturedMeshBuffer->map());
+        const uint32_t regionVertexCount = 3 * maxCapturedTriangles;
+        return {vertices + uint64_t(region) * regionVertexCount,
+                std::min(counts[region], regionVertexCount)};
+    }
+
+    // Host memory, since every captured vertex is read back
+    void reserveCaptureBuffer(uint32_t regionCount)
+    {
+        uint64_t size = sizeof(CapturedVertex) * 3 * maxCapturedTriangles * regionCount;
+        if (size <= capturedMeshBuffer->getSize()) {
+            return;
+        }
+        context.getQueue().waitIdle();
+        capturedMeshBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Storage,
+            .memory = rv::MemoryUsage::Host,
+            .size = size,
+        });
+        capturedCountBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Storage,
+            .memory = rv::MemoryUsage::Host,
+            .size = sizeof(uint32_t) * regionCount,
+        });
+        descSet->set("CapturedMeshes", capturedMeshBuffer);
+        descSet->set("CapturedCounts", capturedCountBuffer);
+        descSet->update();
+        spdlog::info("Capture buffer size: {} MB", size / 1024.0 / 1024.0);
+    }
+
     void drawBottomGrid(const rv::CommandBufferHandle& commandBuffer)
     {
         commandBuffer->bindDescriptorSet(descSet, graphicsPipelines["BottomGrid"].pipeline);
@@ -792,46 +1972,81 @@ private:
         });
     }
 
+    // The grid buffers are cleared by beginStage() when their lifetime begins
+    // The draws and copies of the previous tile or frame read the counters and indirect
+    // arguments that are cleared for the next one
+    void waitForSurfaceDraws(const rv::CommandBufferHandle& commandBuffer) const
+    {
+        commandBuffer->bufferBarrier({surfaceCountBuffer, indirectDispatchCommandBuffer},
+                                     vk::PipelineStageFlagBits::eDrawIndirect |
+                                         vk::PipelineStageFlagBits::eTaskShaderEXT |
+                                         vk::PipelineStageFlagBits::eMeshShaderEXT |
+                                         vk::PipelineStageFlagBits::eVertexShader |
+                                         vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::PipelineStageFlagBits::eTransfer |
+                                         vk::PipelineStageFlagBits::eComputeShader,  //
+                                     vk::AccessFlagBits::eIndirectCommandRead |
+                                         vk::AccessFlagBits::eShaderRead,  //
+                                     vk::AccessFlagBits::eTransferWrite |
+                                         vk::AccessFlagBits::eShaderWrite);
+    }
+
     void clearBuffers(const rv::CommandBufferHandle& commandBuffer) const
     {
         commandBuffer->beginDebugLabel("ClearBuffers");
-        commandBuffer->fillBuffer(topGridValidCellCounts, 0);
-        commandBuffer->fillBuffer(surfaceBlockBuffer, 0);
-        commandBuffer->fillBuffer(bottomGridParticleCounts, 0);
-        commandBuffer->fillBuffer(bottomGridParticleIndices, 0);
         commandBuffer->fillBuffer(surfaceCountBuffer, 0);
-        commandBuffer->fillBuffer(surfaceCellBuffer, 0);
-        commandBuffer->fillBuffer(surfaceVertexBuffer, 0);
-        commandBuffer->fillBuffer(compressedVertexBuffer, 0);
-        commandBuffer->fillBuffer(densityBuffer, 0);
         commandBuffer->fillBuffer(indirectDispatchCommandBuffer, 0);
-        commandBuffer->fillBuffer(cellVertexNormalBuffer, 0);
         commandBuffer->endDebugLabel();
     }
 
 private:
     // Common
     rv::BufferHandle particleBuffer;
+    rv::BufferHandle particleAttributeBuffer;  // in the order of the particle buffer
+    rv::BufferHandle sprayParticleBuffer;      // indices into the particle buffer
 
     // Surface cell & particle & vertex
     rv::BufferHandle surfaceCellBuffer;
-    rv::BufferHandle surfaceVertexBuffer;
+    rv::BufferHandle blockVertexMaskBuffer;
     rv::BufferHandle compressedVertexBuffer;
     rv::BufferHandle densityBuffer;
     rv::BufferHandle surfaceBlockBuffer;
+    rv::BufferHandle blockLodBuffer;
+
+    // Particle set
+    rv::BufferHandle particleSetBuffer;
 
     // Normal
     rv::BufferHandle cellVertexNormalBuffer;
 
+    // Kernel-weighted averages of the particle attributes at the grid vertices
+    rv::BufferHandle vertexAttributeBuffer;
+
     // MC surface
     rv::BufferHandle surfaceCountBuffer;
 
     // Indirect command
     rv::BufferHandle indirectDispatchCommandBuffer;
 
+    // Grid constants of each tile of the frame, selected with pushConstants.gridSlot
+    rv::BufferHandle gridConstantBuffer;
+
+    // Statistics are read statisticsRingSize - 1 frames after they are written
+    static constexpr uint32_t statisticsRingSize = 3;
+    rv::BufferHandle statisticsBuffer;
+
+    rv::BufferHandle marchingCubesTableBuffer;
+
+    // Captured meshes of the offline batches and the vertex counts of their regions
+    // (see shared.glsl)
+    rv::BufferHandle capturedMeshBuffer;
+    rv::BufferHandle capturedCountBuffer;
+
     rv::BufferHandle bottomGridParticleCounts;
     rv::BufferHandle bottomGridParticleIndices;
-    rv::BufferHandle topGridValidCellCounts;
+    rv::BufferHandle cellParticleCountBuffer;
+    rv::BufferHandle blockOccupancyBuffer;
+    rv::BufferHandle compactionOffsetBuffer;
 
     // Images
     vk::Format colorFormat = vk::Format::eB8G8R8A8Unorm;
@@ -847,16 +2062,34 @@ private:
     std::unordered_map<std::string, ComputePipeline> computePipelines = {
         {"CompressVertex", {{"compute.comp", "main_vertex_compress"}}},
         {"Density", {{"compute.comp", "main_density"}}},
+        {"CountParticles", {{"compute.comp", "main_count_particles"}}},
+        {"CountSprayParticles", {{"compute.comp", "main_count_spray_particles"}}},
+        {"ScanSprayParticles", {{"compute.comp", "main_scan_spray_particles"}}},
+        {"ScatterSprayParticles", {{"compute.comp", "main_scatter_spray_particles"}}},
         {"FillTwoGrids", {{"compute.comp", "main_fill_grids"}}},
         {"SurfaceBlock", {{"compute.comp", "main_surface_block"}}},
         {"SurfaceCell", {{"compute.comp", "main_surface_cell"}}},
         {"CellVertexNormal", {{"compute.comp", "main_normal"}}},
+        {"BlockLod", {{"compute.comp", "main_block_lod"}}},
+        {"DispatchArgs", {{"compute.comp", "main_dispatch_args"}}},
+        {"CopyStatistics", {{"compute.comp", "main_copy_statistics"}}},
+        {"CountCapturedVertices", {{"compute.comp", "main_count_captured_vertices"}}},
+        {"ScanCapturedVertices", {{"compute.comp", "main_scan_captured_vertices"}}},
+        {"CaptureMesh", {{"compute.comp", "main_capture_mesh"}}},
+        {"CopyCapturedCounts", {{"compute.comp", "main_copy_captured_counts"}}},
+        {"CountSurfaceBlocks", {{"compute.comp", "main_count_surface_blocks"}}},
+        {"ScanSurfaceBlocks", {{"compute.comp", "main_scan_surface_blocks"}}},
+        {"CountSurfaceCells", {{"compute.comp", "main_count_surface_cells"}}},
+        {"ScanSurfaceCells", {{"compute.comp", "main_scan_surface_cells"}}},
+        {"CountSurfaceVertices", {{"compute.comp", "main_count_surface_vertices"}}},
+        {"ScanSurfaceVertices", {{"compute.comp", "main_scan_surface_vertices"}}},
     };
 
     std::unordered_map<std::string, GraphicsPipeline> graphicsPipelines = {
         {"BottomGrid", {{"bottom_grid.vert", "main"}, {"basic.frag", "main"}}},
         {"TopGrid", {{"top_grid.vert", "main"}, {"basic.frag", "main"}}},
         {"Particle", {{"particle.vert", "main"}, {"basic.frag", "main"}}},
+        {"Spray", {{"particle.vert", "main_spray"}, {"basic.frag", "main"}}},
         {"SurfaceVertex", {{"surface_vertex.vert", "main"}, {"basic.frag", "main"}}},
         {"Mesh", {{"mesh.vert", "main"}, {"mesh.frag", "main"}}},
     };
@@ -866,6 +2099,18 @@ private:
          {{"", ""},
           {"surface.mesh", "main_subgroup_per_block"},
           {"surface.frag", "main_mesh_shader"}}},
+        {"SurfacePerBlockCulled",
+         {{"surface.task", "main_cull_blocks"},
+          {"surface.mesh", "main_culled_subgroup_per_block"},
+          {"surface.frag", "main_mesh_shader"}}},
+        {"SurfaceNets",
+         {{"", ""},
+          {"surface_nets.mesh", "main_surface_nets"},
+          {"surface.frag", "main_mesh_shader"}}},
+        {"SurfaceNetsCulled",
+         {{"surface.task", "main_cull_blocks"},
+          {"surface_nets.mesh", "main_culled_surface_nets"},
+          {"surface.frag", "main_mesh_shader"}}},
     };
 
     // Mesh
@@ -874,10 +2119,47 @@ private:
     rv::Camera camera;
 
     PushConstants pushConstants;
+    GridConstants gridConstants;
+    float maxKernelRadius = 0.0f;  // of the particle sets, covered by the tiling halo
 
     int frame = 0;
 
     uint32_t numParticles = 0;
+    std::vector<glm::vec4> frameParticles;   // all layers of the current frame
+    std::vector<glm::vec4> frameAttributes;  // of frameParticles, if transferAttributes
+    bool transferAttributes = false;
+
+    std::string particleStreamName;
+    std::unique_ptr<ParticleStreamReader> particleStream;
+    std::vector<ParticleSetParams> particleSetParams;
+    uint32_t layerCapacity = 0;
+    uint32_t plannedLifetimeFlags = 0;
+    TransientArena transientArena;
+    std::vector<rv::BufferHandle*> transientHandles;  // of the arena buffers
+    bool skipUnchangedStages = true;
+    bool stageCacheValid = false;  // the outputs of all stages are those of stageInputs
+    StageInputs stageInputs;
+    SurfaceStage firstStage = SurfaceStage::BuildGrids;
+    int motionSamples = 1;
+    float shutter = 0.5f;
+
+    // Offline batch: the frames of the scene in passes of batchFrameCount frames, without waiting
+    // for the queue. Each pass has a slot of the ring, which is read back and reused
+    // batchRingSize frames later. Like the statistics ring, this relies on a frame being done
+    // two frames later.
+    static constexpr uint32_t batchRingSize = 3;
+    bool batchRunning = false;
+    int batchFrameCount = 2;
+    uint32_t batchPassCapacity = 0;  // frames of a slot, 0 until the first pass
+    uint32_t batchNextFrame = 0;
+    uint32_t batchRingIndex = 0;  // slot of the pass recorded in this frame
+    std::array<BatchPass, batchRingSize> batchPasses;
+    CapturedMeshConsumer capturedMeshConsumer;
+    int batchFrames = 0;  // read back
+    uint64_t batchTriangleCount = 0;
+    int batchTruncatedMeshes = 0;
+    float batchTime = 0.0f;
+    std::chrono::steady_clock::time_point batchStartTime;
 
     // ImGui parameters
     float lineWidth = 2.0f;
@@ -889,12 +2171,42 @@ private:
     bool showSurface = true;
     bool runPhysics = true;
     bool surfaceDrawLine = false;
+    bool cullSurfaceBlocks = true;
+    Extractor extractor = Extractor::MarchingCubes;
 
     static constexpr int TIME_BUFFER_SIZE = 300;
     float times[TIME_BUFFER_SIZE] = {0};
 
-    std::array<rv::GPUTimerHandle, 2> gpuTimers;
+    // A set per tile or batch frame, of which the last completed frame wrote timedTileCount
+    // from timedTileOffset
+    std::vector<SurfaceTimers> surfaceTimers;
+    size_t timedTileOffset = 0;
+    size_t timedTileCount = 0;
+    int compactionTimedMode = -1;  // orderedCompaction of the last frame, -1 if not timed
+
+    // Compaction benchmark: compactionBenchmarkFrames frames in each mode
+    int compactionBenchmarkFrames = 0;  // 0 if not running
+    uint32_t compactionBenchmarkMode = 0;
+    int compactionBenchmarkSamples = 0;
+    std::array<double, 3> compactionBenchmarkTimes{};  // summed over the samples
+    uint32_t compactionBenchmarkRestoredMode = 0;
+
+    // Tiled mode
+    bool autoDomain = false;
+    bool tiledMode = false;
+    int tileResolution = 2 * N;
+    TilePlan tilePlan;
+    std::vector<glm::vec4> tileParticles;
+    std::vector<glm::vec4> tileAttributes;
+
+    // CPU extraction
+    std::unique_ptr<Reconstructor> cpuReconstructor;
+    SurfaceMesh cpuMesh;
+    size_t cpuSurfaceBlockCount = 0;
+    size_t cpuSurfaceCellCount = 0;
+    float cpuTime = 0.0f;
 
     Scene scene;
     BackgroundPass backgroundPass;
+    HiZPass hiZPass;
 };
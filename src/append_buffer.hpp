@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// CPU analogue of subgroupAppend() in compute.comp.
+// Threads append into a preallocated array through a Writer, which collects items locally
+// and reserves a whole chunk of slots with one atomic, so the counter is rarely contended.
+template <typename T>
+class AppendBuffer {
+public:
+    static constexpr uint32_t chunkSize = 256;
+
+    AppendBuffer(T* data, uint32_t capacity) : data{data}, capacity{capacity} {}
+
+    class Writer {
+    public:
+        explicit Writer(AppendBuffer& buffer) : buffer{buffer} {}
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        ~Writer() { flush(); }
+
+        void push(const T& item)
+        {
+            items[count++] = item;
+            if (count == chunkSize) {
+                flush();
+            }
+        }
+
+        void flush()
+        {
+            if (count == 0) {
+                return;
+            }
+            uint32_t offset = buffer.counter.fetch_add(count, std::memory_order_relaxed);
+            std::copy_n(items.begin(), std::min(count, buffer.getRemaining(offset)),
+                        buffer.data + std::min(offset, buffer.capacity));
+            count = 0;
+        }
+
+    private:
+        AppendBuffer& buffer;
+        std::array<T, chunkSize> items;
+        uint32_t count = 0;
+    };
+
+    // Number of appended items, clamped to the capacity
+    uint32_t size() const { return std::min(counter.load(), capacity); }
+
+private:
+    uint32_t getRemaining(uint32_t offset) const
+    {
+        return offset < capacity ? capacity - offset : 0;
+    }
+
+    T* data;
+    uint32_t capacity;
+    std::atomic<uint32_t> counter{0};
+};
+
+// Size of the ranges of parallelFor()
+inline uint32_t getParallelRangeSize(uint32_t count, uint32_t threadCount)
+{
+    threadCount = std::clamp(threadCount, 1u, std::max(count, 1u));
+    return std::max((count + threadCount - 1) / threadCount, 1u);
+}
+
+// Call func(begin, end) on threadCount threads for contiguous ranges of [0, count)
+template <typename Func>
+void parallelFor(uint32_t count, uint32_t threadCount, Func&& func)
+{
+    threadCount = std::clamp(threadCount, 1u, std::max(count, 1u));
+    if (threadCount == 1) {
+        func(0u, count);
+        return;
+    }
+    std::vector<std::thread> threads;
+    uint32_t rangeSize = getParallelRangeSize(count, threadCount);
+    for (uint32_t begin = 0; begin < count; begin += rangeSize) {
+        uint32_t end = std::min(begin + rangeSize, count);
+        threads.emplace_back([&func, begin, end] { func(begin, end); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Deterministic alternative to AppendBuffer for the ranges of parallelFor(), as the ordered
+// compaction in compute.comp. Each range appends to a list of its own, and the lists are
+// copied in the order of the ranges at the offsets of their exclusive prefix sum.
+// The output is the same for any thread count.
+template <typename T>
+class OrderedAppendBuffer {
+public:
+    OrderedAppendBuffer(T* data, uint32_t capacity, uint32_t count, uint32_t threadCount)
+        : data{data},
+          capacity{capacity},
+          rangeSize{getParallelRangeSize(count, threadCount)},
+          ranges(std::max((count + rangeSize - 1) / rangeSize, 1u))
+    {
+    }
+
+    class Writer {
+    public:
+        // begin: first index of the range of parallelFor()
+        Writer(OrderedAppendBuffer& buffer, uint32_t begin)
+            : items{buffer.ranges[begin / buffer.rangeSize]}
+        {
+        }
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        void push(const T& item) { items.push_back(item); }
+
+    private:
+        std::vector<T>& items;
+    };
+
+    // Copy the ranges to the array once all writers are done.
+    // Returns the number of items, clamped to the capacity.
+    uint32_t finish()
+    {
+        uint32_t offset = 0;
+        for (const std::vector<T>& items : ranges) {
+            uint32_t count = std::min(static_cast<uint32_t>(items.size()), capacity - offset);
+            std::copy_n(items.begin(), count, data + offset);
+            offset += count;
+        }
+        return offset;
+    }
+
+private:
+    T* data;
+    uint32_t capacity;
+    uint32_t rangeSize;
+    std::vector<std::vector<T>> ranges;
+};
@@ -0,0 +1,539 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../shader/shared.inc"
+#include "append_buffer.hpp"
+#include "storage_format.hpp"
+
+// CPU version of the stages in compute.comp.
+// The buffers have the same layout as the GPU buffers of the same name,
+// so the extractors in mesh_extraction.hpp can read the results of either of them.
+
+inline uint32_t to1D(const glm::uvec3& indices, uint32_t num)
+{
+    return (num * num * indices.z) + (num * indices.y) + indices.x;
+}
+
+inline glm::uvec3 to3D(uint32_t index, uint32_t num)
+{
+    return {index % num, (index % (num * num)) / num, index / (num * num)};
+}
+
+// Cells of a block with local indices in [minIndices, maxIndices], as a bit per cell in the
+// order of to1D(localCellIndices, K). Same as getBlockCellRangeMask() in shared.glsl.
+inline uint64_t getBlockCellRangeMask(const glm::uvec3& minIndices, const glm::uvec3& maxIndices)
+{
+    static_assert(KC == 64, "A block must fit in a 64-bit mask");
+    uint64_t x = ((1u << (maxIndices.x - minIndices.x + 1)) - 1) << minIndices.x;
+    uint64_t y = ((1u << ((maxIndices.y - minIndices.y + 1) * K)) - 1) << (minIndices.y * K);
+    uint64_t z = ((1u << (maxIndices.z - minIndices.z + 1)) - 1) << minIndices.z;
+    uint64_t slice = (x * 0x1111) & y;  // cells of one z slice of 4x4
+    return slice * ((z & 1) | (z & 2) << 15 | (z & 4) << 30 | (z & 8) << 45);
+}
+
+class CpuPipeline {
+public:
+    // The compaction stages run on threadCount threads
+    explicit CpuPipeline(uint32_t threadCount = 1)
+        : threadCount{threadCount},
+          bottomParticleCounts(numCells),
+          bottomParticleIndices(uint64_t(numCells) * maxParticlesPerCell),
+          blockOccupancy(numBlocks),
+          blockVertexMasks(numBlocks),
+          densities(numVertices),
+          cellVertexNormals(numVertices)
+    {
+    }
+
+    // Run all stages for the particles of one grid (the whole area or a single tile).
+    // attributes is null, or holds an attribute per particle (see transferAttributes), which is
+    // averaged into vertexAttributes if constants.transferAttributes is set.
+    void run(const glm::vec4* particles,
+             uint32_t count,
+             const GridConstants& constants,
+             const ParticleSetParams& params,
+             const glm::vec4* attributes = nullptr)
+    {
+        particlePositions = particles;
+        particleAttributes = attributes;
+        gridConstants = constants;
+        particleSet = params;
+        if (!transfersAttributes()) {
+            vertexAttributes.clear();
+        } else if (vertexAttributes.size() != numVertices) {
+            vertexAttributes.resize(numVertices);
+        }
+        clear();
+        fillGrids(count);
+        computeSurfaceBlocks();
+        computeSurfaceCells();
+        compressSurfaceVertices();
+        computeDensities();
+        computeNormals();
+    }
+
+    glm::vec3 getGridOrigin() const { return glm::vec3(gridConstants.gridOrigin); }
+
+    float getCellSize() const { return gridConstants.gridOrigin.w; }
+
+    bool transfersAttributes() const
+    {
+        return gridConstants.transferAttributes != 0 && particleAttributes;
+    }
+
+    // Same as interpolateVertexAttribute() in shared.glsl
+    glm::vec4 interpolateVertexAttribute(uint32_t vertexIndex0,
+                                         uint32_t vertexIndex1,
+                                         float t) const
+    {
+        if (vertexAttributes.empty()) {
+            return glm::vec4{0.0f};
+        }
+        const glm::vec4& attribute0 = vertexAttributes[vertexIndex0];
+        const glm::vec4& attribute1 = vertexAttributes[vertexIndex1];
+        if (densities[vertexIndex0] <= 0.0f) {
+            return attribute1;
+        }
+        if (densities[vertexIndex1] <= 0.0f) {
+            return attribute0;
+        }
+        return glm::mix(attribute0, attribute1, t);
+    }
+
+    float getDensity(const glm::uvec3& vertexIndices) const
+    {
+        uint32_t index = to1D(vertexIndices, N + 1);
+        return index < numVertices ? densities[index] : 0.0f;
+    }
+
+    // Densities at all the vertices of each surface block, KV per block with x fastest.
+    // The stages only evaluate the vertices of the surface cells.
+    std::vector<float> evaluateBlockDensities() const
+    {
+        std::vector<float> blockDensities(surfaceBlocks.size() * KV);
+        for (size_t i = 0; i < surfaceBlocks.size(); i++) {
+            glm::uvec3 block = to3D(surfaceBlocks[i], M);
+            for (uint32_t localVertexIndex = 0; localVertexIndex < KV; localVertexIndex++) {
+                glm::uvec3 vertex = block * uint32_t(K) + to3D(localVertexIndex, K + 1);
+                glm::vec4 attribute;
+                blockDensities[i * KV + localVertexIndex] = quantizeDensity(
+                    computeDensity(vertex, attribute), gridConstants.storageFormat,
+                    particleSet.isoValue);
+            }
+        }
+        return blockDensities;
+    }
+
+    GridConstants gridConstants;
+    ParticleSetParams particleSet;
+    uint32_t threadCount;
+
+    std::vector<uint32_t> bottomParticleCounts;
+    std::vector<uint32_t> bottomParticleIndices;
+    std::vector<uint32_t> cellParticleCounts;  // only if the spray is classified
+    std::vector<uint32_t> sprayParticles;
+    std::vector<uint64_t> blockOccupancy;  // a bit per cell containing particles
+    std::vector<uint32_t> surfaceBlocks;
+    std::vector<uint32_t> surfaceCells;
+    std::vector<glm::uvec4> blockVertexMasks;
+    std::vector<uint32_t> compressedVertices;
+    std::vector<float> densities;
+    std::vector<glm::vec4> cellVertexNormals;
+    std::vector<glm::vec4> vertexAttributes;  // empty if the attributes are not transferred
+    uint32_t surfaceParticleCount = 0;
+
+private:
+    void clear()
+    {
+        std::fill(bottomParticleCounts.begin(), bottomParticleCounts.end(), 0);
+        std::fill(blockOccupancy.begin(), blockOccupancy.end(), 0);
+        std::fill(blockVertexMasks.begin(), blockVertexMasks.end(), glm::uvec4{0});
+        std::fill(densities.begin(), densities.end(), 0.0f);
+        std::fill(cellVertexNormals.begin(), cellVertexNormals.end(), glm::vec4{0.0f});
+        std::fill(vertexAttributes.begin(), vertexAttributes.end(), glm::vec4{0.0f});
+        sprayParticles.clear();
+        surfaceBlocks.clear();
+        surfaceCells.clear();
+        compressedVertices.clear();
+        surfaceParticleCount = 0;
+    }
+
+    static bool isOutOfRange(const glm::ivec3& indices, int num)
+    {
+        return glm::any(glm::lessThan(indices, glm::ivec3(0)))
+               || glm::any(glm::greaterThanEqual(indices, glm::ivec3(num)));
+    }
+
+    static bool isBoundary(const glm::uvec3& cellIndices, uint32_t num)
+    {
+        return glm::any(glm::equal(cellIndices, glm::uvec3(0)))
+               || glm::any(glm::equal(cellIndices, glm::uvec3(num - 1)));
+    }
+
+    bool isOutOfArea(const glm::vec3& worldPos) const
+    {
+        glm::vec3 gridMin = getGridOrigin();
+        glm::vec3 gridMax = gridMin + getCellSize() * static_cast<float>(N);
+        return glm::any(glm::lessThan(worldPos, gridMin + 1e-4f))
+               || glm::any(glm::greaterThan(worldPos, gridMax - 1e-4f));
+    }
+
+    int getOffsetSize() const
+    {
+        return static_cast<int>(particleSet.kernelRadius / getCellSize());
+    }
+
+    glm::uvec3 worldPosToCellIndices(const glm::vec3& worldPos) const
+    {
+        return glm::uvec3((worldPos - getGridOrigin()) / getCellSize());
+    }
+
+    // Same as count_particles
+    void countParticles(uint32_t count)
+    {
+        cellParticleCounts.assign(numCells, 0);
+        for (uint32_t i = 0; i < count; i++) {
+            glm::vec3 worldPos = glm::vec3(particlePositions[gridConstants.tileInfo.x + i]);
+            if (!isOutOfArea(worldPos)) {
+                cellParticleCounts[to1D(worldPosToCellIndices(worldPos), N)]++;
+            }
+        }
+    }
+
+    // Same as isSprayParticle() in compute.comp
+    bool isSprayParticle(const glm::uvec3& cellIndices) const
+    {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < 27; i++) {
+            glm::ivec3 neighborIndices
+                = glm::ivec3(cellIndices) + glm::ivec3(i % 3, (i / 3) % 3, i / 9) - 1;
+            if (!isOutOfRange(neighborIndices, N)) {
+                count += cellParticleCounts[to1D(glm::uvec3(neighborIndices), N)];
+            }
+        }
+        return count <= gridConstants.sprayNeighborCount;
+    }
+
+    // Same as fill_grids
+    void fillGrids(uint32_t count)
+    {
+        bool classifySpray = gridConstants.sprayNeighborCount > 0;
+        if (classifySpray) {
+            countParticles(count);
+        }
+
+        uint32_t particleOffset = gridConstants.tileInfo.x;
+        uint32_t haloBlocks = gridConstants.tileInfo.y;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t particleIndex = particleOffset + i;
+            glm::vec3 worldPos = glm::vec3(particlePositions[particleIndex]);
+            if (isOutOfArea(worldPos)) {
+                continue;
+            }
+
+            glm::uvec3 bottomIndices = worldPosToCellIndices(worldPos);
+            uint32_t bottomIndex = to1D(bottomIndices, N);
+            if (classifySpray && isSprayParticle(bottomIndices)) {
+                glm::uvec3 blockIndices = bottomIndices / glm::uvec3(K);
+                if (glm::all(glm::greaterThanEqual(blockIndices, glm::uvec3(haloBlocks)))
+                    && glm::all(glm::lessThan(blockIndices, glm::uvec3(M - haloBlocks)))) {
+                    sprayParticles.push_back(particleIndex);
+                }
+                continue;
+            }
+            uint32_t particleIndexInCell = bottomParticleCounts[bottomIndex]++;
+            if (particleIndexInCell < maxParticlesPerCell) {
+                bottomParticleIndices[bottomIndex * maxParticlesPerCell + particleIndexInCell]
+                    = particleIndex;
+            }
+            if (particleIndexInCell == 0) {
+                uint32_t localCellIndex = to1D(bottomIndices % glm::uvec3(K), K);
+                blockOccupancy[to1D(bottomIndices / glm::uvec3(K), M)]
+                    |= uint64_t(1) << localCellIndex;
+            }
+        }
+    }
+
+    // Whether the cells of [minCellIndices, maxCellIndices] in the block contain particles.
+    // Out of range blocks count as empty.
+    void testOccupancy(const glm::ivec3& blockIndices,
+                       const glm::ivec3& minCellIndices,
+                       const glm::ivec3& maxCellIndices,
+                       bool& anyOccupied,
+                       bool& anyEmpty) const
+    {
+        glm::ivec3 blockMin = blockIndices * K;
+        glm::ivec3 minIndices = glm::max(minCellIndices, blockMin) - blockMin;
+        glm::ivec3 maxIndices = glm::min(maxCellIndices, blockMin + K - 1) - blockMin;
+        uint64_t range = getBlockCellRangeMask(glm::uvec3(minIndices), glm::uvec3(maxIndices));
+        uint64_t occupied = isOutOfRange(blockIndices, M)
+                                ? 0
+                                : blockOccupancy[to1D(glm::uvec3(blockIndices), M)] & range;
+        anyOccupied = anyOccupied || occupied != 0;
+        anyEmpty = anyEmpty || occupied != range;
+    }
+
+    // Same as surface_block
+    void computeSurfaceBlocks()
+    {
+        uint32_t haloBlocks = gridConstants.tileInfo.y;
+        compact(numBlocks, surfaceBlocks, numBlocks,
+                [&](uint32_t begin, uint32_t end, auto& writer) {
+                    for (uint32_t blockIndex = begin; blockIndex < end; blockIndex++) {
+                        glm::uvec3 blockIndices = to3D(blockIndex, M);
+                        bool isOwned
+                            = glm::all(glm::greaterThanEqual(blockIndices, glm::uvec3(haloBlocks)))
+                              && glm::all(glm::lessThan(blockIndices, glm::uvec3(M - haloBlocks)));
+                        if (isOwned && isSurfaceBlock(blockIndices)) {
+                            writer.push(blockIndex);
+                        }
+                    }
+                });
+    }
+
+    // Call func(begin, end, writer) on the threads for ranges of [0, count), and append what
+    // they push to output. With gridConstants.orderedCompaction, the output is in the order of
+    // the ranges, so it does not depend on the thread count and the scheduling.
+    template <typename Func>
+    void compact(uint32_t count, std::vector<uint32_t>& output, uint32_t capacity, Func&& func)
+    {
+        output.resize(capacity);
+        if (gridConstants.orderedCompaction != 0) {
+            OrderedAppendBuffer<uint32_t> buffer{output.data(), capacity, count, threadCount};
+            parallelFor(count, threadCount, [&](uint32_t begin, uint32_t end) {
+                OrderedAppendBuffer<uint32_t>::Writer writer{buffer, begin};
+                func(begin, end, writer);
+            });
+            output.resize(buffer.finish());
+        } else {
+            AppendBuffer<uint32_t> buffer{output.data(), capacity};
+            parallelFor(count, threadCount, [&](uint32_t begin, uint32_t end) {
+                AppendBuffer<uint32_t>::Writer writer{buffer};
+                func(begin, end, writer);
+            });
+            output.resize(buffer.size());
+        }
+    }
+
+    // The block and the cells around it are neither all empty nor all occupied
+    bool isSurfaceBlock(const glm::uvec3& blockIndices) const
+    {
+        glm::ivec3 minCellIndices = glm::ivec3(blockIndices) * K - 1;
+        glm::ivec3 maxCellIndices = glm::ivec3(blockIndices) * K + K;
+        bool anyOccupied = false;
+        bool anyEmpty = false;
+        for (int z = -1; z <= 1; z++) {
+            for (int y = -1; y <= 1; y++) {
+                for (int x = -1; x <= 1; x++) {
+                    testOccupancy(glm::ivec3(blockIndices) + glm::ivec3(x, y, z), minCellIndices,
+                                  maxCellIndices, anyOccupied, anyEmpty);
+                }
+            }
+        }
+        return anyOccupied && anyEmpty;
+    }
+
+    // The cells in the kernel support are neither all empty nor all occupied
+    bool isSurface(const glm::uvec3& cellIndices) const
+    {
+        int offsetSize = getOffsetSize();
+        glm::ivec3 neiMins = glm::clamp(glm::ivec3(cellIndices) - offsetSize - 1, 0, N - 1);
+        glm::ivec3 neiMaxs = glm::clamp(glm::ivec3(cellIndices) + offsetSize + 1, 0, N - 1);
+
+        bool anyOccupied = false;
+        bool anyEmpty = false;
+        for (int z = neiMins.z / K; z <= neiMaxs.z / K; z++) {
+            for (int y = neiMins.y / K; y <= neiMaxs.y / K; y++) {
+                for (int x = neiMins.x / K; x <= neiMaxs.x / K; x++) {
+                    testOccupancy({x, y, z}, neiMins, neiMaxs, anyOccupied, anyEmpty);
+                }
+            }
+        }
+        return anyOccupied && anyEmpty;
+    }
+
+    // Same as surface_cell
+    void computeSurfaceCells()
+    {
+        std::atomic<uint32_t> particleCount{0};
+        compact(static_cast<uint32_t>(surfaceBlocks.size()), surfaceCells, numCells,
+                [&](uint32_t begin, uint32_t end, auto& writer) {
+                    uint32_t localParticleCount = 0;
+                    for (uint32_t i = begin; i < end; i++) {
+                        localParticleCount += computeSurfaceCells(surfaceBlocks[i], writer);
+                    }
+                    particleCount.fetch_add(localParticleCount, std::memory_order_relaxed);
+                });
+        surfaceParticleCount = particleCount;
+    }
+
+    // Returns the particle count of the surface cells in the block
+    template <typename Writer>
+    uint32_t computeSurfaceCells(uint32_t blockIndex, Writer& writer)
+    {
+        uint32_t particleCount = 0;
+        glm::uvec3 blockIndices = to3D(blockIndex, M);
+        for (uint32_t localCellIndex = 0; localCellIndex < KC; localCellIndex++) {
+            glm::uvec3 cellIndices = blockIndices * glm::uvec3(K) + to3D(localCellIndex, K);
+            if (isBoundary(cellIndices, N) || !isSurface(cellIndices)) {
+                continue;
+            }
+            uint32_t cellIndex = to1D(cellIndices, N);
+            writer.push(cellIndex);
+            particleCount += std::min(bottomParticleCounts[cellIndex], maxParticlesPerCell);
+
+            // Only this thread writes the mask of the block
+            glm::uvec4& mask = blockVertexMasks[blockIndex];
+            glm::uvec3 localCellIndices = to3D(localCellIndex, K);
+            for (uint32_t i = 0; i < 8; i++) {
+                glm::uvec3 offset{i & 1, (i >> 1) & 1, (i >> 2) & 1};
+                uint32_t localVertexIndex = to1D(localCellIndices + offset, K + 1);
+                mask[localVertexIndex / 32] |= 1u << (localVertexIndex % 32);
+            }
+        }
+        return particleCount;
+    }
+
+    static bool hasLocalVertex(const glm::uvec4& mask, uint32_t localVertexIndex)
+    {
+        return ((mask[localVertexIndex / 32] >> (localVertexIndex % 32)) & 1) != 0;
+    }
+
+    // Same as isFirstBlockOfVertex() in compute.comp
+    bool isFirstBlockOfVertex(uint32_t blockIndex, const glm::uvec3& vertexIndices) const
+    {
+        glm::uvec3 firstBlockIndices
+            = (glm::max(vertexIndices, glm::uvec3(1)) - 1u) / glm::uvec3(K);
+        glm::uvec3 lastBlockIndices = glm::min(vertexIndices / glm::uvec3(K), glm::uvec3(M - 1));
+        for (uint32_t i = 0; i < 8; i++) {
+            glm::uvec3 neighborIndices
+                = firstBlockIndices + glm::uvec3{i & 1, (i >> 1) & 1, (i >> 2) & 1};
+            uint32_t neighborIndex = to1D(neighborIndices, M);
+            if (glm::any(glm::greaterThan(neighborIndices, lastBlockIndices))
+                || neighborIndex >= blockIndex) {
+                continue;
+            }
+            glm::uvec3 localVertexIndices = vertexIndices - neighborIndices * glm::uvec3(K);
+            if (hasLocalVertex(blockVertexMasks[neighborIndex], to1D(localVertexIndices, K + 1))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Same as vertex_compress
+    void compressSurfaceVertices()
+    {
+        compact(static_cast<uint32_t>(surfaceBlocks.size()), compressedVertices, numVertices,
+                [&](uint32_t begin, uint32_t end, auto& writer) {
+                    for (uint32_t i = begin; i < end; i++) {
+                        compressSurfaceVertices(surfaceBlocks[i], writer);
+                    }
+                });
+    }
+
+    template <typename Writer>
+    void compressSurfaceVertices(uint32_t blockIndex, Writer& writer)
+    {
+        glm::uvec3 blockIndices = to3D(blockIndex, M);
+        const glm::uvec4& mask = blockVertexMasks[blockIndex];
+        for (uint32_t localVertexIndex = 0; localVertexIndex < (K + 1) * (K + 1) * (K + 1);
+             localVertexIndex++) {
+            glm::uvec3 vertexIndices
+                = blockIndices * glm::uvec3(K) + to3D(localVertexIndex, K + 1);
+            if (hasLocalVertex(mask, localVertexIndex)
+                && isFirstBlockOfVertex(blockIndex, vertexIndices)) {
+                writer.push(to1D(vertexIndices, N + 1));
+            }
+        }
+    }
+
+    float isotropicKernel(glm::vec3 r, float h) const
+    {
+        r *= particleSet.kernelScale;
+        h *= particleSet.kernelScale;
+        float d = glm::length(r) / h;
+        if (d < 0.0f || d >= h) {
+            return 0.0f;
+        }
+        float kernelNorm = 315.0f / (64.0f * PI * std::pow(h, 9.0f));
+        float value = std::max(0.0f, kernelNorm * std::pow(h * h - d * d, 3.0f));
+        return value / (h * h * h);
+    }
+
+    // Same as computeDensity() in kernel.glsl
+    float computeDensity(const glm::uvec3& vertexIndices, glm::vec4& attribute) const
+    {
+        glm::vec3 vertexPos = getGridOrigin() + getCellSize() * glm::vec3(vertexIndices);
+        int offsetSize = getOffsetSize();
+        float totalDensity = 0.0f;
+        glm::vec4 totalAttribute{0.0f};
+        bool transferAttributes = transfersAttributes();
+        for (int x = -offsetSize - 1; x <= offsetSize; x++) {
+            for (int y = -offsetSize - 1; y <= offsetSize; y++) {
+                for (int z = -offsetSize - 1; z <= offsetSize; z++) {
+                    glm::ivec3 neighborCellIndices
+                        = glm::ivec3(vertexIndices) + glm::ivec3(x, y, z);
+                    if (isOutOfRange(neighborCellIndices, N)) {
+                        continue;
+                    }
+                    uint32_t cellIndex = to1D(glm::uvec3(neighborCellIndices), N);
+                    uint32_t particleCount = std::min(bottomParticleCounts[cellIndex],
+                                                      maxParticlesPerCell);
+                    for (uint32_t i = 0; i < particleCount; i++) {
+                        uint32_t particleIndex
+                            = bottomParticleIndices[cellIndex * maxParticlesPerCell + i];
+                        glm::vec3 r = vertexPos - glm::vec3(particlePositions[particleIndex]);
+                        float weight = isotropicKernel(r, particleSet.kernelRadius);
+                        totalDensity += weight;
+                        if (transferAttributes) {
+                            totalAttribute += weight * particleAttributes[particleIndex];
+                        }
+                    }
+                }
+            }
+        }
+        attribute = totalAttribute;
+        return totalDensity;
+    }
+
+    // Same as density. The densities are rounded to gridConstants.storageFormat like the GPU.
+    void computeDensities()
+    {
+        for (uint32_t vertexIndex : compressedVertices) {
+            glm::vec4 attribute;
+            float density = computeDensity(to3D(vertexIndex, N + 1), attribute);
+            densities[vertexIndex] = quantizeDensity(density, gridConstants.storageFormat,
+                                                     particleSet.isoValue);
+            if (!vertexAttributes.empty()) {
+                vertexAttributes[vertexIndex]
+                    = density > 0.0f ? attribute / density : glm::vec4{0.0f};
+            }
+        }
+    }
+
+    // Same as normal, including the evaluation order of the GPU version
+    void computeNormals()
+    {
+        float size = getCellSize();
+        for (uint32_t vertexIndex : compressedVertices) {
+            glm::uvec3 v = to3D(vertexIndex, N + 1);
+            glm::vec3 normal;
+            for (int axis = 0; axis < 3; axis++) {
+                glm::uvec3 offset{0};
+                offset[axis] = 1;
+                normal[axis] = getDensity(v + offset) - getDensity(v - offset) / size;
+            }
+            normal = quantizeNormal(glm::normalize(normal), gridConstants.storageFormat);
+            cellVertexNormals[vertexIndex] = glm::vec4(normal, 1.0f);
+        }
+    }
+
+    const glm::vec4* particlePositions = nullptr;
+    const glm::vec4* particleAttributes = nullptr;
+};
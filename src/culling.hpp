@@ -0,0 +1,111 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <vector>
+
+// CPU version of the surface block culling in surface.task
+
+// Depth pyramid where each texel keeps the farthest depth of the texels it covers
+struct HiZPyramid
+{
+    std::vector<glm::ivec2> levelSizes;
+    std::vector<std::vector<float>> levels;
+
+    HiZPyramid() = default;
+
+    // depth: row-major, depth 1.0 is the far plane
+    HiZPyramid(const std::vector<float>& depth, int width, int height)
+    {
+        levelSizes.push_back({width, height});
+        levels.push_back(depth);
+        while (levelSizes.back() != glm::ivec2{1, 1}) {
+            glm::ivec2 srcSize = levelSizes.back();
+            glm::ivec2 dstSize = glm::max((srcSize + 1) / 2, glm::ivec2{1, 1});
+            const std::vector<float>& src = levels.back();
+            std::vector<float> dst(dstSize.x * dstSize.y, 0.0f);
+            for (int y = 0; y < dstSize.y; y++) {
+                for (int x = 0; x < dstSize.x; x++) {
+                    float maxDepth = 0.0f;
+                    for (int sy = 2 * y; sy <= std::min(2 * y + 1, srcSize.y - 1); sy++) {
+                        for (int sx = 2 * x; sx <= std::min(2 * x + 1, srcSize.x - 1); sx++) {
+                            maxDepth = std::max(maxDepth, src[sy * srcSize.x + sx]);
+                        }
+                    }
+                    dst[y * dstSize.x + x] = maxDepth;
+                }
+            }
+            levelSizes.push_back(dstSize);
+            levels.push_back(std::move(dst));
+        }
+    }
+
+    float fetch(int level, int x, int y) const
+    {
+        const glm::ivec2& size = levelSizes[level];
+        x = std::clamp(x, 0, size.x - 1);
+        y = std::clamp(y, 0, size.y - 1);
+        return levels[level][y * size.x + x];
+    }
+};
+
+// Returns false if the box is outside the frustum or behind the depth pyramid.
+// The pyramid is optional, and the box is treated as visible if it crosses the camera plane.
+inline bool isBoxVisible(const glm::vec3& boxMin,
+                         const glm::vec3& boxMax,
+                         const glm::mat4& viewProj,
+                         const HiZPyramid* hiZ = nullptr)
+{
+    // Frustum: all corners outside the same clip plane
+    glm::bvec3 allLess{true}, allGreater{true};
+    bool allBehind = true;
+    bool crossesCameraPlane = false;
+    glm::vec3 ndcMin{1e10f};
+    glm::vec3 ndcMax{-1e10f};
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner = glm::mix(boxMin, boxMax, glm::vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        glm::vec4 clipPos = viewProj * glm::vec4(corner, 1.0f);
+        for (int axis = 0; axis < 2; axis++) {
+            allLess[axis] = allLess[axis] && clipPos[axis] < -clipPos.w;
+            allGreater[axis] = allGreater[axis] && clipPos[axis] > clipPos.w;
+        }
+        allLess.z = allLess.z && clipPos.z < 0.0f;
+        allGreater.z = allGreater.z && clipPos.z > clipPos.w;
+        allBehind = allBehind && clipPos.w <= 0.0f;
+        if (clipPos.w <= 0.0f) {
+            crossesCameraPlane = true;
+            continue;
+        }
+        glm::vec3 ndcPos = glm::vec3(clipPos) / clipPos.w;
+        ndcMin = glm::min(ndcMin, ndcPos);
+        ndcMax = glm::max(ndcMax, ndcPos);
+    }
+    if (allBehind || glm::any(allLess) || glm::any(allGreater)) {
+        return false;
+    }
+    if (!hiZ || crossesCameraPlane) {
+        return true;
+    }
+
+    // Occlusion: pick the level where the rectangle covers at most 2x2 texels
+    const glm::ivec2& resolution = hiZ->levelSizes[0];
+    glm::vec2 uvMin = glm::vec2(ndcMin) * 0.5f + 0.5f;
+    glm::vec2 uvMax = glm::vec2(ndcMax) * 0.5f + 0.5f;
+    glm::vec2 pixelMin = glm::vec2(uvMin.x, 1.0f - uvMax.y) * glm::vec2(resolution);
+    glm::vec2 pixelMax = glm::vec2(uvMax.x, 1.0f - uvMin.y) * glm::vec2(resolution);
+    pixelMin = glm::clamp(pixelMin, glm::vec2(0.0f), glm::vec2(resolution - 1));
+    pixelMax = glm::clamp(pixelMax, glm::vec2(0.0f), glm::vec2(resolution - 1));
+    float extent = std::max(pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y);
+    int level = static_cast<int>(std::ceil(std::log2(std::max(extent, 1.0f))));
+    level = std::clamp(level, 0, static_cast<int>(hiZ->levels.size()) - 1);
+
+    glm::ivec2 texelMin = glm::ivec2(pixelMin) >> level;
+    glm::ivec2 texelMax = glm::ivec2(pixelMax) >> level;
+    float occluderDepth = 0.0f;
+    for (int y = texelMin.y; y <= texelMax.y; y++) {
+        for (int x = texelMin.x; x <= texelMax.x; x++) {
+            occluderDepth = std::max(occluderDepth, hiZ->fetch(level, x, y));
+        }
+    }
+    return ndcMin.z <= occluderDepth;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <mutex>
+
+#include "../shader/shared.inc"
+#include "append_buffer.hpp"
+
+// Automatic fitting of the N^3 grid to the particles of each frame
+
+struct ParticleBounds
+{
+    glm::vec4 min{FLT_MAX};
+    glm::vec4 max{-FLT_MAX};
+
+    bool isEmpty() const { return glm::any(glm::greaterThan(glm::vec3(min), glm::vec3(max))); }
+
+    void extend(const ParticleBounds& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+};
+
+// Min and max of the particle positions, reduced on threadCount threads.
+// The inner loop works on whole vec4s so that it vectorizes; w is ignored by the users.
+inline ParticleBounds computeParticleBounds(const glm::vec4* particles,
+                                            uint32_t count,
+                                            uint32_t threadCount)
+{
+    ParticleBounds bounds;
+    std::mutex mutex;
+    parallelFor(count, threadCount, [&](uint32_t begin, uint32_t end) {
+        ParticleBounds local;
+        for (uint32_t i = begin; i < end; i++) {
+            local.min = glm::min(local.min, particles[i]);
+            local.max = glm::max(local.max, particles[i]);
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        bounds.extend(local);
+    });
+    return bounds;
+}
+
+// Origin and cell size of a grid of N^3 cells covering the bounds padded by padding.
+// The cell size is rounded up to a step of 2^(1/8) and the origin is snapped to a multiple of
+// the block size, so that the grid does not move while the particles stay in it.
+// Three blocks are kept for the snapping and a margin of at least one block on each side,
+// since the boundary cells are never a surface. Empty bounds give the default area.
+inline glm::vec4 fitGridToBounds(const ParticleBounds& bounds, float padding)
+{
+    if (bounds.isEmpty()) {
+        return glm::vec4{areaOrigin, cellSize.x};
+    }
+    glm::vec3 extent = glm::vec3(bounds.max) - glm::vec3(bounds.min) + 2.0f * padding;
+    float maxExtent = std::max({extent.x, extent.y, extent.z, FLT_MIN});
+    float fittedCellSize = maxExtent / static_cast<float>(N - 3 * K);
+    fittedCellSize = std::exp2(std::ceil(std::log2(fittedCellSize) * 8.0f) / 8.0f);
+
+    float fittedBlockSize = fittedCellSize * K;
+    glm::vec3 paddedMin = glm::vec3(bounds.min) - padding;
+    glm::vec3 origin = (glm::floor(paddedMin / fittedBlockSize) - 1.0f) * fittedBlockSize;
+    return glm::vec4{origin, fittedCellSize};
+}
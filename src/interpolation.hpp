@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+// Sub-frame evaluation of particle caches
+
+// Particles of one sample of a particle set.
+// ids is null if the cache has no particle ids, attributes if it has no particle attributes.
+struct ParticleFrame
+{
+    const glm::vec4* positions = nullptr;
+    const uint64_t* ids = nullptr;
+    const glm::vec4* attributes = nullptr;  // xyz: velocity, w: scalar (see transferAttributes)
+    uint32_t count = 0;
+};
+
+// Append the particles at t in [0, 1] between two adjacent samples. w is set to layer.
+// - Matching ids: each particle of frame0 moves towards the particle with the same id.
+//   Particles without a match keep their position.
+// - Same counts without ids: particles are matched by index.
+// - Otherwise the nearest sample is used as is.
+// If outAttributes is not null, an attribute is appended for each particle, interpolated in the
+// same way. Frames without attributes give zero.
+inline void interpolateParticles(const ParticleFrame& frame0,
+                                 const ParticleFrame& frame1,
+                                 float t,
+                                 float layer,
+                                 std::vector<glm::vec4>& outParticles,
+                                 std::vector<glm::vec4>* outAttributes = nullptr)
+{
+    auto getAttribute = [](const ParticleFrame& frame, uint32_t i) {
+        return frame.attributes ? frame.attributes[i] : glm::vec4{0.0f};
+    };
+    auto append = [&](glm::vec3 position, glm::vec4 attribute) {
+        outParticles.emplace_back(position, layer);
+        if (outAttributes) {
+            outAttributes->push_back(attribute);
+        }
+    };
+
+    if (t > 0.0f && frame0.ids && frame1.ids) {
+        std::unordered_map<uint64_t, uint32_t> indices1;
+        indices1.reserve(frame1.count);
+        for (uint32_t i = 0; i < frame1.count; i++) {
+            indices1.emplace(frame1.ids[i], i);
+        }
+        for (uint32_t i = 0; i < frame0.count; i++) {
+            glm::vec3 position0 = glm::vec3(frame0.positions[i]);
+            auto it = indices1.find(frame0.ids[i]);
+            if (it == indices1.end()) {
+                append(position0, getAttribute(frame0, i));
+                continue;
+            }
+            append(glm::mix(position0, glm::vec3(frame1.positions[it->second]), t),
+                   glm::mix(getAttribute(frame0, i), getAttribute(frame1, it->second), t));
+        }
+        return;
+    }
+
+    if (t > 0.0f && frame0.count == frame1.count) {
+        for (uint32_t i = 0; i < frame0.count; i++) {
+            append(glm::mix(glm::vec3(frame0.positions[i]), glm::vec3(frame1.positions[i]), t),
+                   glm::mix(getAttribute(frame0, i), getAttribute(frame1, i), t));
+        }
+        return;
+    }
+
+    const ParticleFrame& nearest = t < 0.5f ? frame0 : frame1;
+    for (uint32_t i = 0; i < nearest.count; i++) {
+        append(glm::vec3(nearest.positions[i]), getAttribute(nearest, i));
+    }
+}
@@ -0,0 +1,425 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <glm/glm.hpp>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__)
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "mesh_extraction.hpp"
+
+// Job layer that splits a range of frames across workers.
+// Workers take frames from a shared counter, so faster workers take more frames,
+// and the results are handed back to the caller in frame order.
+
+// Particles of all frames in one allocation.
+// On Linux it is a shared mapping, so the worker processes read it without copying.
+class SharedParticleCache {
+public:
+    SharedParticleCache(const std::vector<glm::vec4>& particles,
+                        const std::vector<uint32_t>& particleCounts,
+                        const std::vector<uint32_t>& particleOffsets)
+    {
+        frameCount = static_cast<uint32_t>(particleCounts.size());
+        size = sizeof(Header) + sizeof(uint64_t) * frameCount * 2
+               + sizeof(glm::vec4) * particles.size();
+#if defined(__unix__)
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Failed to map the shared particle cache");
+        }
+#else
+        data = ::operator new(size);
+#endif
+        new (data) Header{};
+        for (uint32_t i = 0; i < frameCount; i++) {
+            getCounts()[i] = particleCounts[i];
+            getOffsets()[i] = particleOffsets[i];
+        }
+        std::memcpy(getParticles(), particles.data(), sizeof(glm::vec4) * particles.size());
+    }
+
+    ~SharedParticleCache()
+    {
+#if defined(__unix__)
+        munmap(data, size);
+#else
+        ::operator delete(data);
+#endif
+    }
+
+    SharedParticleCache(const SharedParticleCache&) = delete;
+    SharedParticleCache& operator=(const SharedParticleCache&) = delete;
+
+    uint32_t getFrameCount() const { return frameCount; }
+
+    uint32_t getParticleCount(int frame) const
+    {
+        return static_cast<uint32_t>(getCounts()[frame]);
+    }
+
+    const glm::vec4* getData(int frame) const { return getParticles() + getOffsets()[frame]; }
+
+    // Index of the next job, shared by all workers
+    std::atomic<uint32_t>& getJobCounter() const { return getHeader()->nextJob; }
+
+private:
+    struct Header
+    {
+        std::atomic<uint32_t> nextJob{0};
+    };
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+    Header* getHeader() const { return static_cast<Header*>(data); }
+
+    uint64_t* getCounts() const
+    {
+        return reinterpret_cast<uint64_t*>(static_cast<char*>(data) + sizeof(Header));
+    }
+
+    uint64_t* getOffsets() const { return getCounts() + frameCount; }
+
+    glm::vec4* getParticles() const
+    {
+        return reinterpret_cast<glm::vec4*>(getOffsets() + frameCount);
+    }
+
+    void* data = nullptr;
+    size_t size = 0;
+    uint32_t frameCount = 0;
+};
+
+struct FrameResult
+{
+    int frame = 0;
+    uint32_t workerIndex = 0;
+    float milliseconds = 0.0f;
+    SurfaceMesh mesh;
+};
+
+// Reconstructs one frame from its particles
+using FrameFunc = std::function<SurfaceMesh(const glm::vec4* particles, uint32_t count)>;
+
+// Called once in each worker, so that each worker owns its pipeline or device
+using WorkerFactory = std::function<FrameFunc(uint32_t workerIndex)>;
+
+// Receives the results in frame order
+using ResultFunc = std::function<void(FrameResult&& result)>;
+
+class JobRunner {
+public:
+    enum class Mode
+    {
+        Thread,   // one thread per worker
+        Process,  // one forked process per worker (Linux only)
+    };
+
+    JobRunner(Mode mode, uint32_t workerCount) : mode{mode}, workerCount{workerCount}
+    {
+        if (workerCount == 0) {
+            throw std::runtime_error("At least one worker is required");
+        }
+#if !defined(__unix__)
+        if (mode == Mode::Process) {
+            throw std::runtime_error("Process mode is only supported on Linux");
+        }
+#endif
+    }
+
+    void run(const SharedParticleCache& cache,
+             const std::vector<int>& frames,
+             const WorkerFactory& createWorker,
+             const ResultFunc& onResult) const
+    {
+        cache.getJobCounter() = 0;
+        OrderedResults results{frames, onResult};
+        if (mode == Mode::Thread) {
+            runThreads(cache, frames, createWorker, results);
+        } else {
+            runProcesses(cache, frames, createWorker, results);
+        }
+        if (results.nextIndex != frames.size()) {
+            throw std::runtime_error("Some frames were not reconstructed");
+        }
+    }
+
+    Mode mode;
+    uint32_t workerCount;
+
+private:
+    // Holds results until all earlier frames have arrived
+    struct OrderedResults
+    {
+        OrderedResults(const std::vector<int>& frames, const ResultFunc& onResult)
+            : frames{frames}, onResult{onResult}
+        {
+        }
+
+        const std::vector<int>& frames;
+        const ResultFunc& onResult;
+        std::map<size_t, FrameResult> pending;
+        size_t nextIndex = 0;
+
+        void add(size_t jobIndex, FrameResult&& result)
+        {
+            pending.emplace(jobIndex, std::move(result));
+            while (!pending.empty() && pending.begin()->first == nextIndex) {
+                onResult(std::move(pending.begin()->second));
+                pending.erase(pending.begin());
+                nextIndex++;
+            }
+        }
+    };
+
+    // Calls func(jobIndex, result) for each job taken by this worker
+    template <typename Func>
+    static void work(const SharedParticleCache& cache,
+                     const std::vector<int>& frames,
+                     uint32_t workerIndex,
+                     const FrameFunc& reconstruct,
+                     Func&& func)
+    {
+        while (true) {
+            uint32_t jobIndex = cache.getJobCounter().fetch_add(1);
+            if (jobIndex >= frames.size()) {
+                return;
+            }
+            int frame = frames[jobIndex];
+            auto start = std::chrono::steady_clock::now();
+
+            FrameResult result;
+            result.frame = frame;
+            result.workerIndex = workerIndex;
+            result.mesh = reconstruct(cache.getData(frame), cache.getParticleCount(frame));
+            std::chrono::duration<float, std::milli> elapsed
+                = std::chrono::steady_clock::now() - start;
+            result.milliseconds = elapsed.count();
+            func(jobIndex, std::move(result));
+        }
+    }
+
+    void runThreads(const SharedParticleCache& cache,
+                    const std::vector<int>& frames,
+                    const WorkerFactory& createWorker,
+                    OrderedResults& results) const
+    {
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::vector<std::pair<size_t, FrameResult>> arrived;
+        uint32_t finishedWorkers = 0;
+        std::exception_ptr error;
+
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < workerCount; i++) {
+            threads.emplace_back([&, i] {
+                try {
+                    FrameFunc reconstruct = createWorker(i);
+                    work(cache, frames, i, reconstruct, [&](size_t jobIndex, FrameResult&& r) {
+                        std::lock_guard lock{mutex};
+                        arrived.emplace_back(jobIndex, std::move(r));
+                        condition.notify_one();
+                    });
+                } catch (...) {
+                    std::lock_guard lock{mutex};
+                    error = std::current_exception();
+                }
+                std::lock_guard lock{mutex};
+                finishedWorkers++;
+                condition.notify_one();
+            });
+        }
+
+        // Results are handed over on the calling thread
+        std::unique_lock lock{mutex};
+        while (true) {
+            condition.wait(lock, [&] {
+                return !arrived.empty() || finishedWorkers == workerCount;
+            });
+            auto batch = std::move(arrived);
+            arrived.clear();
+            bool finished = finishedWorkers == workerCount;
+            lock.unlock();
+            for (auto& [jobIndex, result] : batch) {
+                results.add(jobIndex, std::move(result));
+            }
+            lock.lock();
+            if (finished && arrived.empty()) {
+                break;
+            }
+        }
+        lock.unlock();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+#if defined(__unix__)
+    struct ResultHeader
+    {
+        uint64_t jobIndex;
+        int32_t frame;
+        uint32_t workerIndex;
+        float milliseconds;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t attributeCount;  // vertexCount, or 0 if the mesh has no attributes
+    };
+
+    static void writeAll(int fd, const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t written = write(fd, bytes, size);
+            if (written < 0) {
+                throw std::runtime_error("Failed to send a result to the parent process");
+            }
+            bytes += written;
+            size -= written;
+        }
+    }
+
+    // Returns false at the end of the stream
+    static bool readAll(int fd, void* data, size_t size)
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0) {
+            ssize_t count = read(fd, bytes, size);
+            if (count < 0) {
+                throw std::runtime_error("Failed to receive a result from a worker process");
+            }
+            if (count == 0) {
+                return false;
+            }
+            bytes += count;
+            size -= count;
+        }
+        return true;
+    }
+
+    static void sendResult(int fd, size_t jobIndex, const FrameResult& result)
+    {
+        const SurfaceMesh& mesh = result.mesh;
+        ResultHeader header{jobIndex,
+                            result.frame,
+                            result.workerIndex,
+                            result.milliseconds,
+                            static_cast<uint32_t>(mesh.positions.size()),
+                            static_cast<uint32_t>(mesh.indices.size()),
+                            static_cast<uint32_t>(mesh.attributes.size())};
+        writeAll(fd, &header, sizeof(header));
+        writeAll(fd, mesh.positions.data(), sizeof(glm::vec3) * header.vertexCount);
+        writeAll(fd, mesh.normals.data(), sizeof(glm::vec3) * header.vertexCount);
+        writeAll(fd, mesh.attributes.data(), sizeof(glm::vec4) * header.attributeCount);
+        writeAll(fd, mesh.indices.data(), sizeof(uint32_t) * header.indexCount);
+    }
+
+    static bool receiveResult(int fd, size_t& jobIndex, FrameResult& result)
+    {
+        ResultHeader header;
+        if (!readAll(fd, &header, sizeof(header))) {
+            return false;
+        }
+        jobIndex = header.jobIndex;
+        result.frame = header.frame;
+        result.workerIndex = header.workerIndex;
+        result.milliseconds = header.milliseconds;
+        SurfaceMesh& mesh = result.mesh;
+        mesh.positions.resize(header.vertexCount);
+        mesh.normals.resize(header.vertexCount);
+        mesh.attributes.resize(header.attributeCount);
+        mesh.indices.resize(header.indexCount);
+        return readAll(fd, mesh.positions.data(), sizeof(glm::vec3) * header.vertexCount)
+               && readAll(fd, mesh.normals.data(), sizeof(glm::vec3) * header.vertexCount)
+               && readAll(fd, mesh.attributes.data(), sizeof(glm::vec4) * header.attributeCount)
+               && readAll(fd, mesh.indices.data(), sizeof(uint32_t) * header.indexCount);
+    }
+#endif
+
+    void runProcesses(const SharedParticleCache& cache,
+                      const std::vector<int>& frames,
+                      const WorkerFactory& createWorker,
+                      OrderedResults& results) const
+    {
+#if defined(__unix__)
+        // Each worker sends its results through its own pipe
+        std::vector<pid_t> pids;
+        std::vector<pollfd> pipes;
+        for (uint32_t i = 0; i < workerCount; i++) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                throw std::runtime_error("Failed to create a pipe");
+            }
+            pid_t pid = fork();
+            if (pid < 0) {
+                throw std::runtime_error("Failed to fork a worker process");
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                int status = 0;
+                try {
+                    FrameFunc reconstruct = createWorker(i);
+                    work(cache, frames, i, reconstruct, [&](size_t jobIndex, FrameResult&& r) {
+                        sendResult(fds[1], jobIndex, r);
+                    });
+                } catch (...) {
+                    status = 1;
+                }
+                close(fds[1]);
+                _exit(status);
+            }
+            close(fds[1]);
+            pids.push_back(pid);
+            pipes.push_back({fds[0], POLLIN, 0});
+        }
+
+        size_t openPipes = pipes.size();
+        while (openPipes > 0) {
+            if (poll(pipes.data(), pipes.size(), -1) < 0) {
+                throw std::runtime_error("Failed to wait for the worker processes");
+            }
+            for (auto& workerPipe : pipes) {
+                if (workerPipe.fd < 0 || workerPipe.revents == 0) {
+                    continue;
+                }
+                size_t jobIndex;
+                FrameResult result;
+                if (receiveResult(workerPipe.fd, jobIndex, result)) {
+                    results.add(jobIndex, std::move(result));
+                } else {
+                    close(workerPipe.fd);
+                    workerPipe.fd = -1;
+                    openPipes--;
+                }
+            }
+        }
+
+        bool failed = false;
+        for (pid_t pid : pids) {
+            int status = 0;
+            waitpid(pid, &status, 0);
+            failed = failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        }
+        if (failed) {
+            throw std::runtime_error("A worker process failed");
+        }
+#endif
+    }
+};
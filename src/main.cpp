@@ -1,9 +1,410 @@
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+
 #include "app.hpp"
+#include "job.hpp"
+#include "mesh_comparison.hpp"
+#include "particle_stream.hpp"
+#include "sparse_volume.hpp"
+#include "storage_format.hpp"
+
+// The first particle set of the example scene, moved out of the scene
+Scene::ParticleSet loadFirstParticleSet()
+{
+    Scene scene;
+    scene.load(ASSET_DIR + "FluidBeach.abc");
+    if (scene.particleSets.empty()) {
+        throw std::runtime_error("The scene has no particles");
+    }
+    return std::move(scene.particleSets[0]);
+}
 
-int main()
+// Reconstruct frames on the CPU with 1..maxWorkers workers and print the throughput
+void runJobBenchmark(uint32_t maxWorkers, JobRunner::Mode mode, int maxFrames)
+{
+    const auto set = loadFirstParticleSet();
+    SharedParticleCache cache{set.particles, set.particleCounts, set.particleOffsets};
+
+    std::vector<int> frames;
+    for (int i = 0; i < std::min(set.frameCount, maxFrames); i++) {
+        frames.push_back(i);
+    }
+
+    // Each worker is single-threaded
+    auto createWorker = [](uint32_t) -> FrameFunc {
+        auto reconstructor = std::make_shared<Reconstructor>(std::make_unique<CpuBackend>(1));
+        return [reconstructor](const glm::vec4* particles, uint32_t count) {
+            reconstructor->setParticles({particles, count});
+            return reconstructor->reconstruct().mesh;
+        };
+    };
+
+    double baseFramesPerSecond = 0.0;
+    for (uint32_t workerCount = 1; workerCount <= maxWorkers; workerCount++) {
+        JobRunner runner{mode, workerCount};
+        size_t triangleCount = 0;
+        int lastFrame = -1;
+        rv::CPUTimer timer;
+        runner.run(cache, frames, createWorker, [&](FrameResult&& result) {
+            if (result.frame <= lastFrame) {
+                throw std::runtime_error("Results are out of order");
+            }
+            lastFrame = result.frame;
+            triangleCount += result.mesh.getTriangleCount();
+        });
+        double framesPerSecond = frames.size() / (timer.elapsedInMilli() / 1000.0);
+        if (workerCount == 1) {
+            baseFramesPerSecond = framesPerSecond;
+        }
+        spdlog::info("workers: {}, frames/s: {:.2f}, speedup: {:.2f}, triangles: {}", workerCount,
+                     framesPerSecond, framesPerSecond / baseFramesPerSecond, triangleCount);
+    }
+}
+
+// Compare the meshes of each storage format against 32-bit densities and vec4 normals
+// and print the largest error over the frames
+void runStorageComparison(int maxFrames)
+{
+    const auto set = loadFirstParticleSet();
+    const uint32_t formats[] = {
+        densityFloat32 | octahedralNormals,
+        densityFloat16,
+        densityFloat16 | octahedralNormals,
+        densityUnorm16,
+        densityUnorm16 | octahedralNormals,
+    };
+    MeshError errors[std::size(formats)];
+
+    Reconstructor reconstructor;
+    ReconstructionParams params;
+    for (int frame = 0; frame < std::min(set.frameCount, maxFrames); frame++) {
+        reconstructor.setParticles({set.particles.data() + set.particleOffsets[frame],
+                                    set.particleCounts[frame]});
+        params.storageFormat = densityFloat32;
+        reconstructor.setParams(params);
+        SurfaceMesh reference = reconstructor.reconstruct().mesh;
+        for (size_t i = 0; i < std::size(formats); i++) {
+            params.storageFormat = formats[i];
+            reconstructor.setParams(params);
+            MeshError error = compareMeshes(reference, reconstructor.reconstruct().mesh,
+                                            params.gridOrigin.w);
+            errors[i].hausdorffDistance
+                = std::max(errors[i].hausdorffDistance, error.hausdorffDistance);
+            errors[i].maxNormalAngle = std::max(errors[i].maxNormalAngle, error.maxNormalAngle);
+            errors[i].meanNormalAngle = std::max(errors[i].meanNormalAngle, error.meanNormalAngle);
+        }
+    }
+
+    const char* densityNames[] = {"float32", "float16", "unorm16"};
+    for (size_t i = 0; i < std::size(formats); i++) {
+        spdlog::info("density: {}, normal: {}, hausdorff: {:.5f} ({:.3f} cells), "
+                     "normal angle max: {:.3f} deg, mean: {:.4f} deg",
+                     densityNames[formats[i] & densityFormatMask],
+                     (formats[i] & octahedralNormals) != 0 ? "octahedral" : "vec4",
+                     errors[i].hausdorffDistance, errors[i].hausdorffDistance / cellSize.x,
+                     errors[i].maxNormalAngle, errors[i].meanNormalAngle);
+    }
+}
+
+// Extract count iso values in [minIsoValue, maxIsoValue] from the densities of one run,
+// and compare the time with a run per iso value
+void runIsoSweep(float minIsoValue, float maxIsoValue, int count, int maxFrames)
+{
+    const auto set = loadFirstParticleSet();
+    ReconstructionParams params;
+    for (int i = 0; i < count; i++) {
+        float t = count > 1 ? static_cast<float>(i) / static_cast<float>(count - 1) : 0.0f;
+        params.isoSweep.push_back(glm::mix(minIsoValue, maxIsoValue, t));
+    }
+    std::vector<size_t> triangleCounts(params.isoSweep.size());
+
+    Reconstructor reconstructor;
+    double sweepTime = 0.0;
+    double separateTime = 0.0;
+    for (int frame = 0; frame < std::min(set.frameCount, maxFrames); frame++) {
+        reconstructor.setParticles({set.particles.data() + set.particleOffsets[frame],
+                                    set.particleCounts[frame]});
+        reconstructor.setParams(params);
+        rv::CPUTimer timer;
+        const Reconstruction& reconstruction = reconstructor.reconstruct();
+        sweepTime += timer.elapsedInMilli();
+        for (size_t i = 0; i < reconstruction.isoSurfaces.size(); i++) {
+            triangleCounts[i] += reconstruction.isoSurfaces[i].mesh.getTriangleCount();
+        }
+
+        ReconstructionParams separateParams = params;
+        separateParams.isoSweep.clear();
+        rv::CPUTimer separateTimer;
+        for (float isoValue : params.isoSweep) {
+            separateParams.isoValue = isoValue;
+            reconstructor.setParams(separateParams);
+            reconstructor.reconstruct();
+        }
+        separateTime += separateTimer.elapsedInMilli();
+    }
+
+    for (size_t i = 0; i < params.isoSweep.size(); i++) {
+        spdlog::info("iso: {:.4f}, triangles: {}", params.isoSweep[i], triangleCounts[i]);
+    }
+    spdlog::info("sweep: {:.1f} ms, separate runs: {:.1f} ms", sweepTime, separateTime);
+}
+
+// Write the surface blocks of each frame to <directory>/frame_<index>.spvl, as densities or as
+// distances in a band of bandCells cells, and compare the sizes with indexed meshes
+void runVolumeExport(const std::string& directory, float bandCells, int maxFrames)
+{
+    const auto set = loadFirstParticleSet();
+    Reconstructor reconstructor;
+    ReconstructionParams params;
+    params.evaluateBlocks = true;
+    reconstructor.setParams(params);
+    uint64_t volumeBytes = 0;
+    uint64_t meshBytes = 0;
+    int frameCount = std::min(set.frameCount, maxFrames);
+    for (int frame = 0; frame < frameCount; frame++) {
+        reconstructor.setParticles({set.particles.data() + set.particleOffsets[frame],
+                                    set.particleCounts[frame]});
+        const Reconstruction& reconstruction = reconstructor.reconstruct();
+
+        SparseVolumeHeader header;
+        header.gridOrigin = reconstruction.gridOrigin;
+        header.isoValue = reconstructor.getParams().isoValue;
+        if (bandCells > 0.0f) {
+            header.valueType = SparseVolumeValue::Distance;
+            header.bandWidth = bandCells * reconstruction.gridOrigin.w;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "/frame_%04d.spvl", frame);
+        SparseVolumeWriter writer{directory + name, header};
+        writeSurfaceBlocks(reconstruction, writer);
+        writer.close();
+
+        const SurfaceMesh& mesh = reconstruction.mesh;
+        volumeBytes += sizeof(SparseVolumeHeader)
+                       + (sizeof(glm::ivec3) + sizeof(float) * KV) * writer.getHeader().blockCount;
+        meshBytes += sizeof(glm::vec3) * (mesh.positions.size() + mesh.normals.size())
+                     + sizeof(uint32_t) * mesh.indices.size();
+    }
+    spdlog::info("frames: {}, volumes: {:.1f} MB, meshes: {:.1f} MB", frameCount,
+                 volumeBytes / 1024.0 / 1024.0, meshBytes / 1024.0 / 1024.0);
+}
+
+// Write a triangle list captured by an offline batch of the viewer as a binary PLY file,
+// with a face for every three vertices
+void writeCapturedMesh(const std::string& path, std::span<const CapturedVertex> vertices)
+{
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    file << "ply\nformat binary_little_endian 1.0\n"
+         << "element vertex " << vertices.size() << "\n"
+         << "property float x\nproperty float y\nproperty float z\n"
+         << "property float nx\nproperty float ny\nproperty float nz\n"
+         << "element face " << vertices.size() / 3 << "\n"
+         << "property list uchar uint vertex_indices\nend_header\n";
+    for (const CapturedVertex& vertex : vertices) {
+        glm::vec3 normal = decodeOctahedral(glm::unpackSnorm2x16(vertex.normal));
+        file.write(reinterpret_cast<const char*>(&vertex.position), sizeof(glm::vec3));
+        file.write(reinterpret_cast<const char*>(&normal), sizeof(glm::vec3));
+    }
+    for (uint32_t i = 0; i + 2 < vertices.size(); i += 3) {
+        const uint32_t indices[3] = {i, i + 1, i + 2};
+        file.put(3);
+        file.write(reinterpret_cast<const char*>(indices), sizeof(indices));
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+// FNV-1a of the positions and indices of a mesh
+uint64_t hashMesh(const SurfaceMesh& mesh)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&](const void* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 0x100000001b3ull;
+        }
+    };
+    add(mesh.positions.data(), sizeof(glm::vec3) * mesh.positions.size());
+    add(mesh.indices.data(), sizeof(uint32_t) * mesh.indices.size());
+    return hash;
+}
+
+// Reconstruct each frame twice on all threads, with atomic and with ordered compaction, and
+// print the time and the frames whose two meshes differ. The GPU stages are timed afterwards
+// in the viewer (see FluidApp::startCompactionBenchmark).
+void runCompactionBenchmark(int maxFrames)
+{
+    const auto set = loadFirstParticleSet();
+    int frameCount = std::min(set.frameCount, maxFrames);
+    Reconstructor reconstructor;
+    for (bool ordered : {false, true}) {
+        ReconstructionParams params;
+        params.orderedCompaction = ordered;
+        reconstructor.setParams(params);
+        double time = 0.0;
+        int differentFrames = 0;
+        for (int frame = 0; frame < frameCount; frame++) {
+            reconstructor.setParticles({set.particles.data() + set.particleOffsets[frame],
+                                        set.particleCounts[frame]});
+            uint64_t hashes[2];
+            for (uint64_t& hash : hashes) {
+                rv::CPUTimer timer;
+                const Reconstruction& reconstruction = reconstructor.reconstruct();
+                time += timer.elapsedInMilli();
+                hash = hashMesh(reconstruction.mesh);
+            }
+            differentFrames += hashes[0] != hashes[1] ? 1 : 0;
+        }
+        spdlog::info("{} compaction: {:.2f} ms/frame, frames with different meshes: {} / {}",
+                     ordered ? "ordered" : "atomic", time / (2.0 * frameCount), differentFrames,
+                     frameCount);
+    }
+}
+
+volatile std::sig_atomic_t interrupted = 0;
+
+// Stand-in for a running simulator: publishes the frames of the first particle set to the
+// particle stream in a loop, at the given rate, until interrupted
+void runStreamProducer(const std::string& name, float framesPerSecond, int maxFrames)
+{
+    const auto set = loadFirstParticleSet();
+    int frameCount = std::min(set.frameCount, maxFrames);
+    ParticleStreamWriter writer{name, set.maxParticleCount};
+    std::signal(SIGINT, [](int) { interrupted = 1; });
+    spdlog::info("Streaming {} frames to {} at {} frames/s", frameCount, name, framesPerSecond);
+
+    auto interval = std::chrono::duration<double>(1.0 / framesPerSecond);
+    auto nextTime = std::chrono::steady_clock::now();
+    for (int i = 0; !interrupted; i = (i + 1) % frameCount) {
+        std::span<glm::vec4> particles = writer.beginFrame();
+        const glm::vec4* source = set.particles.data() + set.particleOffsets[i];
+        for (uint32_t j = 0; j < set.particleCounts[i]; j++) {
+            particles[j] = glm::vec4(glm::vec3(source[j]), 0.0f);
+        }
+        writer.endFrame(set.particleCounts[i], static_cast<float>(i));
+
+        nextTime += std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
+        std::this_thread::sleep_until(nextTime);
+    }
+}
+
+// Usage:
+//   SurfaceReconstruction
+//   SurfaceReconstruction --bench-jobs <max workers> [--processes] [--frames <count>]
+//   SurfaceReconstruction --compare-storage [--frames <count>]
+//   SurfaceReconstruction --bench-compaction [--frames <count>]
+//   SurfaceReconstruction --iso-sweep <min> <max> <count> [--frames <count>]
+//   SurfaceReconstruction --export-volume <directory> [--band <cells>] [--frames <count>]
+//   SurfaceReconstruction --stream <name>
+//   SurfaceReconstruction --produce-stream <name> [--fps <rate>] [--frames <count>]
+int main(int argc, char* argv[])
 {
     try {
-        FluidApp app{};
+        uint32_t benchWorkers = 0;
+        JobRunner::Mode mode = JobRunner::Mode::Thread;
+        int maxFrames = INT_MAX;
+        bool compareStorage = false;
+        bool benchCompaction = false;
+        int isoSweepCount = 0;
+        float isoSweepMin = 0.0f;
+        float isoSweepMax = 0.0f;
+        std::string volumeDirectory;
+        std::string batchDirectory;
+        float bandCells = 0.0f;
+        std::string streamName;
+        std::string producedStreamName;
+        float framesPerSecond = 30.0f;
+        for (int i = 1; i < argc; i++) {
+            if (std::strcmp(argv[i], "--bench-jobs") == 0 && i + 1 < argc) {
+                benchWorkers = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (std::strcmp(argv[i], "--processes") == 0) {
+                mode = JobRunner::Mode::Process;
+            } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+                maxFrames = std::stoi(argv[++i]);
+            } else if (std::strcmp(argv[i], "--compare-storage") == 0) {
+                compareStorage = true;
+            } else if (std::strcmp(argv[i], "--bench-compaction") == 0) {
+                benchCompaction = true;
+            } else if (std::strcmp(argv[i], "--iso-sweep") == 0 && i + 3 < argc) {
+                isoSweepMin = std::stof(argv[++i]);
+                isoSweepMax = std::stof(argv[++i]);
+                isoSweepCount = std::stoi(argv[++i]);
+            } else if (std::strcmp(argv[i], "--export-volume") == 0 && i + 1 < argc) {
+                volumeDirectory = argv[++i];
+            } else if (std::strcmp(argv[i], "--export-batch") == 0 && i + 1 < argc) {
+                batchDirectory = argv[++i];
+            } else if (std::strcmp(argv[i], "--band") == 0 && i + 1 < argc) {
+                bandCells = std::stof(argv[++i]);
+            } else if (std::strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+                streamName = argv[++i];
+            } else if (std::strcmp(argv[i], "--produce-stream") == 0 && i + 1 < argc) {
+                producedStreamName = argv[++i];
+            } else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+                framesPerSecond = std::stof(argv[++i]);
+            }
+        }
+
+        if (compareStorage) {
+            runStorageComparison(maxFrames);
+            return 0;
+        }
+
+        if (benchCompaction) {
+            runCompactionBenchmark(maxFrames);
+
+            // The GPU stages are timed by the viewer, which logs them after the frames
+            FluidApp app;
+            app.startCompactionBenchmark(std::min(maxFrames, 100));
+            app.run();
+            return 0;
+        }
+
+        if (isoSweepCount > 0) {
+            runIsoSweep(isoSweepMin, isoSweepMax, isoSweepCount, maxFrames);
+            return 0;
+        }
+
+        if (!volumeDirectory.empty()) {
+            runVolumeExport(volumeDirectory, bandCells, maxFrames);
+            return 0;
+        }
+
+        // The viewer captures all frames in offline batches and writes them to
+        // <directory>/frame_<index>_set_<set>.ply as they are read back
+        if (!batchDirectory.empty()) {
+            FluidApp app;
+            app.setCapturedMeshConsumer(
+                [&](int frame, uint32_t set, std::span<const CapturedVertex> vertices) {
+                    char name[48];
+                    std::snprintf(name, sizeof(name), "/frame_%04d_set_%u.ply", frame, set);
+                    writeCapturedMesh(batchDirectory + name, vertices);
+                });
+            app.startBatch();
+            app.run();
+            return 0;
+        }
+
+        if (benchWorkers > 0) {
+            runJobBenchmark(benchWorkers, mode, maxFrames);
+            return 0;
+        }
+
+        if (!producedStreamName.empty()) {
+            runStreamProducer(producedStreamName, framesPerSecond, maxFrames);
+            return 0;
+        }
+
+        FluidApp app{streamName};
         app.run();
     } catch (const std::exception& e) {
         spdlog::error(e.what());
@@ -0,0 +1,437 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "../shader/shared.inc"
+
+// Marching cubes tables. triangleTable is the reference table: the shaders read the compact
+// tables generated from it below, which are uploaded by the app (see MarchingCubesTables in
+// marching_cubes_table.glsl). The other tables are copies of the ones in the shader.
+
+// clang-format off
+// Stored values are edge index
+inline constexpr int triangleTable[256][12] = {
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}, // 0
+    {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 8, 1, 1, 8, 9, -1, -1, -1, -1, -1, -1},
+    {2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {8, 0, 11, 11, 0, 2, -1, -1, -1, -1, -1, -1},
+    {3, 11, 9, 9, 0, 3, 1, 9, 11, 11, 2, 1},
+    {11, 1, 2, 11, 9, 1, 11, 8, 9, -1, -1, -1},
+    {1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {10, 1, 0, 0, 8, 10, 8, 3, 2, 2, 10, 8},
+    {10, 2, 9, 9, 2, 0, -1, -1, -1, -1, -1, -1}, // 10
+    {8, 2, 3, 8, 10, 2, 8, 9, 10, -1, -1, -1},
+    {11, 3, 10, 10, 3, 1, -1, -1, -1, -1, -1, -1},
+    {10, 0, 1, 10, 8, 0, 10, 11, 8, -1, -1, -1},
+    {9, 3, 0, 9, 11, 3, 9, 10, 11, -1, -1, -1},
+    {8, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1},
+    {4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {7, 4, 3, 3, 4, 0, -1, -1, -1, -1, -1, -1},
+    {7, 8, 0, 0, 1, 7, 1, 9, 4, 4, 7, 1},
+    {1, 4, 9, 1, 7, 4, 1, 3, 7, -1, -1, -1},
+    {2, 3, 8, 8, 4, 2, 4, 7, 11, 11, 2, 4}, // 20
+    {4, 11, 7, 4, 2, 11, 4, 0, 2, -1, -1, -1},
+    {0, 9, 1, 8, 7, 4, 11, 3, 2, -1, -1, -1},
+    {7, 4, 11, 11, 4, 2, 2, 4, 9, 2, 9, 1},
+    {4, 8, 7, 2, 1, 10, -1, -1, -1, -1, -1, -1},
+    {7, 4, 3, 3, 4, 0, 10, 2, 1, -1, -1, -1},
+    {10, 2, 9, 9, 2, 0, 7, 4, 8, -1, -1, -1},
+    {10, 2, 3, 10, 3, 4, 3, 7, 4, 9, 10, 4},
+    {1, 10, 3, 3, 10, 11, 4, 8, 7, -1, -1, -1},
+    {10, 11, 1, 11, 7, 4, 1, 11, 4, 1, 4, 0},
+    {7, 4, 8, 9, 3, 0, 9, 11, 3, 9, 10, 11}, // 30
+    {7, 4, 11, 4, 9, 11, 9, 10, 11, -1, -1, -1},
+    {9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 0, 9, 9, 5, 3, 5, 4, 8, 8, 3, 5},
+    {4, 5, 0, 0, 5, 1, -1, -1, -1, -1, -1, -1},
+    {5, 8, 4, 5, 3, 8, 5, 1, 3, -1, -1, -1},
+    {9, 4, 5, 11, 3, 2, -1, -1, -1, -1, -1, -1},
+    {2, 11, 0, 0, 11, 8, 5, 9, 4, -1, -1, -1},
+    {4, 5, 0, 0, 5, 1, 11, 3, 2, -1, -1, -1},
+    {5, 1, 4, 1, 2, 11, 4, 1, 11, 4, 11, 8},
+    {4, 9, 1, 1, 2, 4, 2, 10, 5, 5, 4, 2}, // 40
+    {9, 4, 5, 0, 3, 8, 2, 1, 10, -1, -1, -1},
+    {2, 5, 10, 2, 4, 5, 2, 0, 4, -1, -1, -1},
+    {10, 2, 5, 5, 2, 4, 4, 2, 3, 4, 3, 8},
+    {11, 3, 10, 10, 3, 1, 4, 5, 9, -1, -1, -1},
+    {4, 5, 9, 10, 0, 1, 10, 8, 0, 10, 11, 8},
+    {11, 3, 0, 11, 0, 5, 0, 4, 5, 10, 11, 5},
+    {4, 5, 8, 5, 10, 8, 10, 11, 8, -1, -1, -1},
+    {8, 7, 9, 9, 7, 5, -1, -1, -1, -1, -1, -1},
+    {3, 9, 0, 3, 5, 9, 3, 7, 5, -1, -1, -1},
+    {7, 0, 8, 7, 1, 0, 7, 5, 1, -1, -1, -1}, // 50
+    {7, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1},
+    {5, 9, 7, 7, 9, 8, 2, 11, 3, -1, -1, -1},
+    {2, 11, 7, 2, 7, 9, 7, 5, 9, 0, 2, 9},
+    {2, 11, 3, 7, 0, 8, 7, 1, 0, 7, 5, 1},
+    {2, 11, 1, 11, 7, 1, 7, 5, 1, -1, -1, -1},
+    {8, 7, 9, 9, 7, 5, 2, 1, 10, -1, -1, -1},
+    {10, 2, 1, 3, 9, 0, 3, 5, 9, 3, 7, 5},
+    {7, 5, 8, 5, 10, 2, 8, 5, 2, 8, 2, 0},
+    {10, 2, 5, 2, 3, 5, 3, 7, 5, -1, -1, -1},
+    {8, 7, 5, 8, 5, 9, 11, 3, 10, 3, 1, 10}, // 60
+    {5, 11, 7, 10, 11, 5, 1, 9, 0, -1, -1, -1},
+    {11, 5, 10, 7, 5, 11, 8, 3, 0, -1, -1, -1},
+    {5, 11, 7, 10, 11, 5, -1, -1, -1, -1, -1, -1},
+    {6, 7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 7, 7, 6, 0, 6, 11, 3, 3, 0, 6},
+    {6, 7, 11, 0, 9, 1, -1, -1, -1, -1, -1, -1},
+    {9, 1, 8, 8, 1, 3, 6, 7, 11, -1, -1, -1},
+    {3, 2, 7, 7, 2, 6, -1, -1, -1, -1, -1, -1},
+    {0, 7, 8, 0, 6, 7, 0, 2, 6, -1, -1, -1},
+    {6, 7, 2, 2, 7, 3, 9, 1, 0, -1, -1, -1}, // 70
+    {6, 7, 8, 6, 8, 1, 8, 9, 1, 2, 6, 1},
+    {1, 2, 11, 11, 7, 1, 7, 6, 10, 10, 1, 7},
+    {3, 8, 0, 11, 6, 7, 10, 2, 1, -1, -1, -1},
+    {0, 9, 2, 2, 9, 10, 7, 11, 6, -1, -1, -1},
+    {6, 7, 11, 8, 2, 3, 8, 10, 2, 8, 9, 10},
+    {7, 10, 6, 7, 1, 10, 7, 3, 1, -1, -1, -1},
+    {8, 0, 7, 7, 0, 6, 6, 0, 1, 6, 1, 10},
+    {7, 3, 6, 3, 0, 9, 6, 3, 9, 6, 9, 10},
+    {6, 7, 10, 7, 8, 10, 8, 9, 10, -1, -1, -1},
+    {11, 6, 8, 8, 6, 4, -1, -1, -1, -1, -1, -1}, // 80
+    {6, 3, 11, 6, 0, 3, 6, 4, 0, -1, -1, -1},
+    {11, 6, 8, 8, 6, 4, 1, 0, 9, -1, -1, -1},
+    {1, 3, 9, 3, 11, 6, 9, 3, 6, 9, 6, 4},
+    {2, 8, 3, 2, 4, 8, 2, 6, 4, -1, -1, -1},
+    {4, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1},
+    {9, 1, 0, 2, 8, 3, 2, 4, 8, 2, 6, 4},
+    {9, 1, 4, 1, 2, 4, 2, 6, 4, -1, -1, -1},
+    {4, 8, 6, 6, 8, 11, 1, 10, 2, -1, -1, -1},
+    {1, 10, 2, 6, 3, 11, 6, 0, 3, 6, 4, 0},
+    {11, 6, 4, 11, 4, 8, 10, 2, 9, 2, 0, 9}, // 90
+    {10, 4, 9, 6, 4, 10, 11, 2, 3, -1, -1, -1},
+    {4, 8, 3, 4, 3, 10, 3, 1, 10, 6, 4, 10},
+    {1, 10, 0, 10, 6, 0, 6, 4, 0, -1, -1, -1},
+    {4, 10, 6, 9, 10, 4, 0, 8, 3, -1, -1, -1},
+    {4, 10, 6, 9, 10, 4, -1, -1, -1, -1, -1, -1},
+    {11, 7, 4, 4, 9, 11, 9, 5, 6, 6, 11, 9},
+    {4, 5, 9, 7, 11, 6, 3, 8, 0, -1, -1, -1},
+    {1, 0, 5, 5, 0, 4, 11, 6, 7, -1, -1, -1},
+    {11, 6, 7, 5, 8, 4, 5, 3, 8, 5, 1, 3},
+    {3, 2, 7, 7, 2, 6, 9, 4, 5, -1, -1, -1}, // 100
+    {5, 9, 4, 0, 7, 8, 0, 6, 7, 0, 2, 6},
+    {3, 2, 6, 3, 6, 7, 1, 0, 5, 0, 4, 5},
+    {6, 1, 2, 5, 1, 6, 4, 7, 8, -1, -1, -1},
+    {10, 2, 1, 6, 7, 11, 4, 5, 9, -1, -1, -1},
+    {0, 3, 8, 4, 5, 9, 11, 6, 7, 10, 2, 1},
+    {7, 11, 6, 2, 5, 10, 2, 4, 5, 2, 0, 4},
+    {8, 4, 7, 5, 10, 6, 3, 11, 2, -1, -1, -1},
+    {9, 4, 5, 7, 10, 6, 7, 1, 10, 7, 3, 1},
+    {10, 6, 5, 7, 8, 4, 1, 9, 0, -1, -1, -1},
+    {4, 3, 0, 7, 3, 4, 6, 5, 10, -1, -1, -1}, // 110
+    {8, 4, 5, 5, 10, 8, 10, 6, 7, 7, 8, 10},
+    {9, 6, 5, 9, 11, 6, 9, 8, 11, -1, -1, -1},
+    {11, 6, 3, 3, 6, 0, 0, 6, 5, 0, 5, 9},
+    {11, 6, 5, 11, 5, 0, 5, 1, 0, 8, 11, 0},
+    {11, 6, 3, 6, 5, 3, 5, 1, 3, -1, -1, -1},
+    {9, 8, 5, 8, 3, 2, 5, 8, 2, 5, 2, 6},
+    {5, 9, 6, 9, 0, 6, 0, 2, 6, -1, -1, -1},
+    {1, 6, 5, 2, 6, 1, 3, 0, 8, -1, -1, -1},
+    {1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1},
+    {2, 1, 10, 9, 6, 5, 9, 11, 6, 9, 8, 11}, // 120
+    {9, 0, 1, 3, 11, 2, 5, 10, 6, -1, -1, -1},
+    {11, 0, 8, 2, 0, 11, 10, 6, 5, -1, -1, -1},
+    {5, 10, 2, 2, 3, 5, 3, 11, 6, 6, 5, 3},
+    {1, 8, 3, 9, 8, 1, 5, 10, 6, -1, -1, -1},
+    {6, 5, 9, 9, 0, 6, 0, 1, 10, 10, 6, 0},
+    {8, 3, 0, 5, 10, 6, -1, -1, -1, -1, -1, -1},
+    {6, 5, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 3, 8, 6, 10, 5, -1, -1, -1, -1, -1, -1},
+    {6, 5, 9, 9, 0, 6, 0, 1, 10, 10, 6, 0}, // 130
+    {3, 8, 1, 1, 8, 9, 6, 10, 5, -1, -1, -1},
+    {5, 10, 2, 2, 3, 5, 3, 11, 6, 6, 5, 3},
+    {8, 0, 11, 11, 0, 2, 5, 6, 10, -1, -1, -1},
+    {1, 0, 9, 2, 11, 3, 6, 10, 5, -1, -1, -1},
+    {5, 6, 10, 11, 1, 2, 11, 9, 1, 11, 8, 9},
+    {5, 6, 1, 1, 6, 2, -1, -1, -1, -1, -1, -1},
+    {5, 6, 1, 1, 6, 2, 8, 0, 3, -1, -1, -1},
+    {6, 9, 5, 6, 0, 9, 6, 2, 0, -1, -1, -1},
+    {6, 2, 5, 2, 3, 8, 5, 2, 8, 5, 8, 9},
+    {3, 6, 11, 3, 5, 6, 3, 1, 5, -1, -1, -1}, // 140
+    {8, 0, 1, 8, 1, 6, 1, 5, 6, 11, 8, 6},
+    {11, 3, 6, 6, 3, 5, 5, 3, 0, 5, 0, 9},
+    {5, 6, 9, 6, 11, 9, 11, 8, 9, -1, -1, -1},
+    {8, 4, 5, 5, 10, 8, 10, 6, 7, 7, 8, 10},
+    {0, 3, 4, 4, 3, 7, 10, 5, 6, -1, -1, -1},
+    {5, 6, 10, 4, 8, 7, 0, 9, 1, -1, -1, -1},
+    {6, 10, 5, 1, 4, 9, 1, 7, 4, 1, 3, 7},
+    {7, 4, 8, 6, 10, 5, 2, 11, 3, -1, -1, -1},
+    {10, 5, 6, 4, 11, 7, 4, 2, 11, 4, 0, 2},
+    {4, 8, 7, 6, 10, 5, 3, 2, 11, 1, 0, 9}, // 150
+    {1, 2, 10, 11, 7, 6, 9, 5, 4, -1, -1, -1},
+    {2, 1, 6, 6, 1, 5, 8, 7, 4, -1, -1, -1},
+    {0, 3, 7, 0, 7, 4, 2, 1, 6, 1, 5, 6},
+    {8, 7, 4, 6, 9, 5, 6, 0, 9, 6, 2, 0},
+    {7, 2, 3, 6, 2, 7, 5, 4, 9, -1, -1, -1},
+    {4, 8, 7, 3, 6, 11, 3, 5, 6, 3, 1, 5},
+    {5, 0, 1, 4, 0, 5, 7, 6, 11, -1, -1, -1},
+    {9, 5, 4, 6, 11, 7, 0, 8, 3, -1, -1, -1},
+    {11, 7, 4, 4, 9, 11, 9, 5, 6, 6, 11, 9},
+    {6, 10, 4, 4, 10, 9, -1, -1, -1, -1, -1, -1}, // 160
+    {6, 10, 4, 4, 10, 9, 3, 8, 0, -1, -1, -1},
+    {0, 10, 1, 0, 6, 10, 0, 4, 6, -1, -1, -1},
+    {6, 10, 1, 6, 1, 8, 1, 3, 8, 4, 6, 8},
+    {9, 4, 10, 10, 4, 6, 3, 2, 11, -1, -1, -1},
+    {2, 11, 8, 2, 8, 0, 6, 10, 4, 10, 9, 4},
+    {11, 3, 2, 0, 10, 1, 0, 6, 10, 0, 4, 6},
+    {6, 8, 4, 11, 8, 6, 2, 10, 1, -1, -1, -1},
+    {4, 1, 9, 4, 2, 1, 4, 6, 2, -1, -1, -1},
+    {3, 8, 0, 4, 1, 9, 4, 2, 1, 4, 6, 2},
+    {6, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1}, // 170
+    {3, 8, 2, 8, 4, 2, 4, 6, 2, -1, -1, -1},
+    {4, 6, 9, 6, 11, 3, 9, 6, 3, 9, 3, 1},
+    {8, 6, 11, 4, 6, 8, 9, 0, 1, -1, -1, -1},
+    {11, 3, 6, 3, 0, 6, 0, 4, 6, -1, -1, -1},
+    {8, 6, 11, 4, 6, 8, -1, -1, -1, -1, -1, -1},
+    {10, 7, 6, 10, 8, 7, 10, 9, 8, -1, -1, -1},
+    {3, 7, 0, 7, 6, 10, 0, 7, 10, 0, 10, 9},
+    {6, 10, 7, 7, 10, 8, 8, 10, 1, 8, 1, 0},
+    {6, 10, 7, 10, 1, 7, 1, 3, 7, -1, -1, -1},
+    {3, 2, 11, 10, 7, 6, 10, 8, 7, 10, 9, 8}, // 180
+    {2, 9, 0, 10, 9, 2, 6, 11, 7, -1, -1, -1},
+    {0, 8, 3, 7, 6, 11, 1, 2, 10, -1, -1, -1},
+    {1, 2, 11, 11, 7, 1, 7, 6, 10, 10, 1, 7},
+    {2, 1, 9, 2, 9, 7, 9, 8, 7, 6, 2, 7},
+    {2, 7, 6, 3, 7, 2, 0, 1, 9, -1, -1, -1},
+    {8, 7, 0, 7, 6, 0, 6, 2, 0, -1, -1, -1},
+    {7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1},
+    {8, 1, 9, 3, 1, 8, 11, 7, 6, -1, -1, -1},
+    {11, 7, 6, 1, 9, 0, -1, -1, -1, -1, -1, -1},
+    {0, 8, 7, 7, 6, 0, 6, 11, 3, 3, 0, 6}, // 190
+    {11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {7, 11, 5, 5, 11, 10, -1, -1, -1, -1, -1, -1},
+    {10, 5, 11, 11, 5, 7, 0, 3, 8, -1, -1, -1},
+    {7, 11, 5, 5, 11, 10, 0, 9, 1, -1, -1, -1},
+    {7, 11, 10, 7, 10, 5, 3, 8, 1, 8, 9, 1},
+    {5, 2, 10, 5, 3, 2, 5, 7, 3, -1, -1, -1},
+    {5, 7, 10, 7, 8, 0, 10, 7, 0, 10, 0, 2},
+    {0, 9, 1, 5, 2, 10, 5, 3, 2, 5, 7, 3},
+    {9, 7, 8, 5, 7, 9, 10, 1, 2, -1, -1, -1},
+    {1, 11, 2, 1, 7, 11, 1, 5, 7, -1, -1, -1}, // 200
+    {8, 0, 3, 1, 11, 2, 1, 7, 11, 1, 5, 7},
+    {7, 11, 2, 7, 2, 9, 2, 0, 9, 5, 7, 9},
+    {7, 9, 5, 8, 9, 7, 3, 11, 2, -1, -1, -1},
+    {3, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1},
+    {8, 0, 7, 0, 1, 7, 1, 5, 7, -1, -1, -1},
+    {0, 9, 3, 9, 5, 3, 5, 7, 3, -1, -1, -1},
+    {9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1},
+    {8, 5, 4, 8, 10, 5, 8, 11, 10, -1, -1, -1},
+    {0, 3, 11, 0, 11, 5, 11, 10, 5, 4, 0, 5},
+    {1, 0, 9, 8, 5, 4, 8, 10, 5, 8, 11, 10}, // 210
+    {10, 3, 11, 1, 3, 10, 9, 5, 4, -1, -1, -1},
+    {3, 2, 8, 8, 2, 4, 4, 2, 10, 4, 10, 5},
+    {10, 5, 2, 5, 4, 2, 4, 0, 2, -1, -1, -1},
+    {5, 4, 9, 8, 3, 0, 10, 1, 2, -1, -1, -1},
+    {4, 9, 1, 1, 2, 4, 2, 10, 5, 5, 4, 2},
+    {8, 11, 4, 11, 2, 1, 4, 11, 1, 4, 1, 5},
+    {0, 5, 4, 1, 5, 0, 2, 3, 11, -1, -1, -1},
+    {0, 11, 2, 8, 11, 0, 4, 9, 5, -1, -1, -1},
+    {5, 4, 9, 2, 3, 11, -1, -1, -1, -1, -1, -1},
+    {4, 8, 5, 8, 3, 5, 3, 1, 5, -1, -1, -1}, // 220
+    {0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1},
+    {3, 0, 9, 9, 5, 3, 5, 4, 8, 8, 3, 5},
+    {5, 4, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {11, 4, 7, 11, 9, 4, 11, 10, 9, -1, -1, -1},
+    {0, 3, 8, 11, 4, 7, 11, 9, 4, 11, 10, 9},
+    {11, 10, 7, 10, 1, 0, 7, 10, 0, 7, 0, 4},
+    {3, 10, 1, 11, 10, 3, 7, 8, 4, -1, -1, -1},
+    {3, 2, 10, 3, 10, 4, 10, 9, 4, 7, 3, 4},
+    {9, 2, 10, 0, 2, 9, 8, 4, 7, -1, -1, -1},
+    {3, 4, 7, 0, 4, 3, 1, 2, 10, -1, -1, -1}, // 230
+    {7, 8, 4, 10, 1, 2, -1, -1, -1, -1, -1, -1},
+    {7, 11, 4, 4, 11, 9, 9, 11, 2, 9, 2, 1},
+    {1, 9, 0, 4, 7, 8, 2, 3, 11, -1, -1, -1},
+    {7, 11, 4, 11, 2, 4, 2, 0, 4, -1, -1, -1},
+    {2, 3, 8, 8, 4, 2, 4, 7, 11, 11, 2, 4},
+    {9, 4, 1, 4, 7, 1, 7, 3, 1, -1, -1, -1},
+    {7, 8, 0, 0, 1, 7, 1, 9, 4, 4, 7, 1},
+    {3, 4, 7, 0, 4, 3, -1, -1, -1, -1, -1, -1},
+    {7, 8, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {11, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1}, // 240
+    {0, 3, 9, 3, 11, 9, 11, 10, 9, -1, -1, -1},
+    {1, 0, 10, 0, 8, 10, 8, 11, 10, -1, -1, -1},
+    {10, 3, 11, 1, 3, 10, -1, -1, -1, -1, -1, -1},
+    {3, 2, 8, 2, 10, 8, 10, 9, 8, -1, -1, -1},
+    {9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1},
+    {10, 1, 0, 0, 8, 10, 8, 3, 2, 2, 10, 8},
+    {2, 10, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 1, 11, 1, 9, 11, 9, 8, 11, -1, -1, -1},
+    {3, 11, 9, 9, 0, 3, 1, 9, 11, 11, 2, 1},
+    {11, 0, 8, 2, 0, 11, -1, -1, -1, -1, -1, -1}, // 250
+    {3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1},
+    {1, 9, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {8, 3, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+};
+
+inline constexpr uint32_t triangleCounts[256] = {
+    0, 1, 1, 2, 1, 2, 4, 3, 1, 4, 2, 3, 2, 3, 3, 2, // 0 -
+    1, 2, 4, 3, 4, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3, // 16 -
+    1, 4, 2, 3, 2, 3, 3, 4, 4, 3, 3, 4, 3, 4, 4, 3, // 32 -
+    2, 3, 3, 2, 3, 4, 4, 3, 3, 4, 4, 3, 4, 3, 3, 2, // 48 -
+    1, 4, 2, 3, 2, 3, 3, 4, 4, 3, 3, 4, 3, 4, 4, 3, // 64 -
+    2, 3, 3, 4, 3, 2, 4, 3, 3, 4, 4, 3, 4, 3, 3, 2, // 80 -
+    4, 3, 3, 4, 3, 4, 4, 3, 3, 4, 4, 3, 4, 3, 3, 4, // 96 -
+    3, 4, 4, 3, 4, 3, 3, 2, 4, 3, 3, 4, 3, 4, 2, 1, // 112 -
+    1, 2, 4, 3, 4, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3, // 128 -
+    4, 3, 3, 4, 3, 4, 4, 3, 3, 4, 4, 3, 4, 3, 3, 4, // 144 -
+    2, 3, 3, 4, 3, 4, 4, 3, 3, 4, 2, 3, 4, 3, 3, 2, // 160 -
+    3, 4, 4, 3, 4, 3, 3, 4, 4, 3, 3, 2, 3, 2, 4, 1, // 176 -
+    2, 3, 3, 4, 3, 4, 4, 3, 3, 4, 4, 3, 2, 3, 3, 2, // 192 -
+    3, 4, 4, 3, 4, 3, 3, 4, 4, 3, 3, 2, 3, 2, 4, 1, // 208 -
+    3, 4, 4, 3, 4, 3, 3, 2, 4, 3, 3, 4, 3, 4, 2, 1, // 224 -
+    2, 3, 3, 2, 3, 2, 4, 1, 3, 4, 2, 1, 2, 1, 1, 0, // 240 -
+};
+
+// Vertices of each edge (see the figure in marching_cubes_table.glsl)
+inline constexpr uint32_t edgeVertexIndices[12][2] = {
+    {0, 1}, {1, 3}, {3, 2}, {2, 0},
+    {4, 5}, {5, 7}, {7, 6}, {6, 4},
+    {0, 4}, {1, 5}, {3, 7}, {2, 6}};
+
+inline constexpr uint32_t vertexIndexToOffset[8][3] = {
+    {0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0},
+    {0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}};
+// clang-format on
+
+// Triangle table with the edge indices of a case in 4-bit fields:
+// edges 0-7 in the first word, edges 8-11 in the low half of the second word,
+// and the triangle count in the top bits of the second word
+using PackedTriangles = std::array<uint32_t, 2>;
+
+inline constexpr uint32_t packedTriangleCountShift = 28;
+
+constexpr uint32_t getPackedTriangleCount(const PackedTriangles& triangles)
+{
+    return triangles[1] >> packedTriangleCountShift;
+}
+
+constexpr uint32_t getPackedTriangleEdge(const PackedTriangles& triangles, uint32_t i)
+{
+    return (triangles[i / 8] >> (i % 8 * 4)) & 0xF;
+}
+
+constexpr std::array<PackedTriangles, 256> packTriangleTable()
+{
+    std::array<PackedTriangles, 256> table{};
+    for (uint32_t mcCase = 0; mcCase < 256; mcCase++) {
+        for (uint32_t i = 0; i < triangleCounts[mcCase] * 3; i++) {
+            table[mcCase][i / 8] |= static_cast<uint32_t>(triangleTable[mcCase][i]) << (i % 8 * 4);
+        }
+        table[mcCase][1] |= triangleCounts[mcCase] << packedTriangleCountShift;
+    }
+    return table;
+}
+
+inline constexpr std::array<PackedTriangles, 256> packedTriangleTable = packTriangleTable();
+
+// All 256 cases unpack to the reference table
+constexpr bool matchesTriangleTable(const std::array<PackedTriangles, 256>& table)
+{
+    for (uint32_t mcCase = 0; mcCase < 256; mcCase++) {
+        uint32_t count = getPackedTriangleCount(table[mcCase]);
+        if (count != triangleCounts[mcCase]) {
+            return false;
+        }
+        for (uint32_t i = 0; i < 12; i++) {
+            int edge = static_cast<int>(getPackedTriangleEdge(table[mcCase], i));
+            if ((i < count * 3 ? edge : -1) != triangleTable[mcCase][i]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+static_assert(matchesTriangleTable(packedTriangleTable));
+
+// Edges of a block half in the mesh shader (see getGridVertexIndicesFromBlockEdge() in
+// surface.mesh): 60 x edges of 4x5x3, 60 y edges of 5x4x3 and 50 z edges of 5x5x2
+inline constexpr uint32_t blockHalfCellCount = KC / 2;
+inline constexpr uint32_t blockHalfEdgeCount = 170;
+
+// Block half edge of each edge of the cells in a block half, 4 8-bit fields per word.
+// The 12 edges of a cell are the 3 words from cell * 3.
+constexpr std::array<uint32_t, blockHalfCellCount * 3> packBlockEdgeTable()
+{
+    static_assert(K == 4, "The block edge layout of surface.mesh assumes 4^3 cells per block");
+    constexpr uint32_t edgeOffsets[12] = {0, 61, 4, 60, 20, 81, 24, 80, 120, 121, 126, 125};
+    std::array<uint32_t, blockHalfCellCount * 3> table{};
+    for (uint32_t cell = 0; cell < blockHalfCellCount; cell++) {
+        uint32_t j = cell / K % K;
+        uint32_t k = cell / (K * K);
+        for (uint32_t edge = 0; edge < 12; edge++) {
+            uint32_t blockEdge = cell % 16 + k * 20 + edgeOffsets[edge];
+            if (edge >= 8) {
+                blockEdge += j + 5 * k;
+            } else if (edge % 2 == 1) {
+                blockEdge += j;
+            }
+            uint32_t field = cell * 12 + edge;
+            table[field / 4] |= blockEdge << (field % 4 * 8);
+        }
+    }
+    return table;
+}
+
+inline constexpr std::array<uint32_t, blockHalfCellCount * 3> packedBlockEdgeTable
+    = packBlockEdgeTable();
+
+// Every block half edge belongs to a cell, and the cells sharing an edge agree on its axis
+constexpr bool coversBlockHalfEdges(const std::array<uint32_t, blockHalfCellCount * 3>& table)
+{
+    bool covered[blockHalfEdgeCount] = {};
+    for (uint32_t field = 0; field < blockHalfCellCount * 12; field++) {
+        uint32_t blockEdge = (table[field / 4] >> (field % 4 * 8)) & 0xFF;
+        uint32_t edge = field % 12;
+        uint32_t axis = edge >= 8 ? 2 : edge % 2;
+        if (blockEdge >= blockHalfEdgeCount || blockEdge / 60 != axis) {
+            return false;
+        }
+        covered[blockEdge] = true;
+    }
+    for (bool edgeCovered : covered) {
+        if (!edgeCovered) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(coversBlockHalfEdges(packedBlockEdgeTable));
+
+// Layout of the MarchingCubesTables buffer
+struct MarchingCubesTables
+{
+    std::array<PackedTriangles, 256> packedTriangles = packedTriangleTable;
+    std::array<uint32_t, blockHalfCellCount * 3> packedBlockEdges = packedBlockEdgeTable;
+};
+
+// Start corner and axis of each cell edge, so that the extractors need not order the vertices
+struct CellEdge
+{
+    uint32_t start[3];
+    uint32_t axis;
+};
+
+constexpr std::array<CellEdge, 12> computeCellEdges()
+{
+    std::array<CellEdge, 12> edges{};
+    for (uint32_t edge = 0; edge < 12; edge++) {
+        const uint32_t* v0 = vertexIndexToOffset[edgeVertexIndices[edge][0]];
+        const uint32_t* v1 = vertexIndexToOffset[edgeVertexIndices[edge][1]];
+        for (uint32_t i = 0; i < 3; i++) {
+            edges[edge].start[i] = v0[i] < v1[i] ? v0[i] : v1[i];
+            if (v0[i] != v1[i]) {
+                edges[edge].axis = i;
+            }
+        }
+    }
+    return edges;
+}
+
+inline constexpr std::array<CellEdge, 12> cellEdges = computeCellEdges();
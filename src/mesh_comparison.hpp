@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_extraction.hpp"
+
+// Error of a mesh against a reference mesh, e.g. to choose the storage format of a shot
+
+struct MeshError
+{
+    float hausdorffDistance = 0.0f;  // in world units
+    float maxNormalAngle = 0.0f;     // in degrees
+    float meanNormalAngle = 0.0f;    // in degrees
+};
+
+// Nearest vertex queries on a uniform grid of the given cell size
+class VertexLookup {
+public:
+    VertexLookup(const SurfaceMesh& mesh, float cellSize) : mesh{mesh}, cellSize{cellSize}
+    {
+        for (uint32_t i = 0; i < mesh.positions.size(); i++) {
+            cells[getKey(toCell(mesh.positions[i]))].push_back(i);
+        }
+    }
+
+    // Searches the rings of cells around the position until the nearest vertex is found.
+    // Returns UINT32_MAX for an empty mesh.
+    uint32_t findNearest(const glm::vec3& position) const
+    {
+        uint32_t nearest = UINT32_MAX;
+        float nearestDistance = INFINITY;
+        glm::ivec3 center = toCell(position);
+        for (int ring = 0; ring < maxRings; ring++) {
+            for (int z = -ring; z <= ring; z++) {
+                for (int y = -ring; y <= ring; y++) {
+                    for (int x = -ring; x <= ring; x++) {
+                        if (std::max({std::abs(x), std::abs(y), std::abs(z)}) != ring) {
+                            continue;
+                        }
+                        auto it = cells.find(getKey(center + glm::ivec3(x, y, z)));
+                        if (it == cells.end()) {
+                            continue;
+                        }
+                        for (uint32_t i : it->second) {
+                            float distance = glm::distance(position, mesh.positions[i]);
+                            if (distance < nearestDistance) {
+                                nearest = i;
+                                nearestDistance = distance;
+                            }
+                        }
+                    }
+                }
+            }
+            // Vertices in the next ring are at least ring * cellSize away
+            if (nearestDistance <= ring * cellSize) {
+                break;
+            }
+        }
+        return nearest;
+    }
+
+private:
+    static constexpr int maxRings = 16;
+
+    glm::ivec3 toCell(const glm::vec3& position) const
+    {
+        return glm::ivec3(glm::floor(position / cellSize));
+    }
+
+    static uint64_t getKey(const glm::ivec3& cell)
+    {
+        auto bits = [](int value) { return uint64_t(uint32_t(value) & 0x1fffff); };
+        return bits(cell.x) | (bits(cell.y) << 21) | (bits(cell.z) << 42);
+    }
+
+    const SurfaceMesh& mesh;
+    float cellSize;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+};
+
+// Symmetric Hausdorff distance between the vertices of the meshes, and the angle between the
+// normals of each vertex of mesh and the nearest vertex of reference.
+// Vertices farther than 16 cells from the other mesh are not found and count as 16 cells.
+inline MeshError compareMeshes(const SurfaceMesh& reference,
+                               const SurfaceMesh& mesh,
+                               float cellSize)
+{
+    MeshError error;
+    if (reference.positions.empty() || mesh.positions.empty()) {
+        error.hausdorffDistance = reference.positions.size() == mesh.positions.size()
+                                      ? 0.0f
+                                      : INFINITY;
+        return error;
+    }
+
+    VertexLookup referenceLookup{reference, cellSize};
+    VertexLookup meshLookup{mesh, cellSize};
+    float notFoundDistance = cellSize * 16.0f;
+    double angleSum = 0.0;
+    for (uint32_t i = 0; i < mesh.positions.size(); i++) {
+        uint32_t nearest = referenceLookup.findNearest(mesh.positions[i]);
+        if (nearest == UINT32_MAX) {
+            error.hausdorffDistance = std::max(error.hausdorffDistance, notFoundDistance);
+            continue;
+        }
+        float distance = glm::distance(mesh.positions[i], reference.positions[nearest]);
+        error.hausdorffDistance = std::max(error.hausdorffDistance, distance);
+
+        // atan2 keeps the precision of small angles, unlike acos of the dot product
+        const glm::vec3& normal = mesh.normals[i];
+        const glm::vec3& referenceNormal = reference.normals[nearest];
+        float angle = glm::degrees(std::atan2(glm::length(glm::cross(normal, referenceNormal)),
+                                              glm::dot(normal, referenceNormal)));
+        error.maxNormalAngle = std::max(error.maxNormalAngle, angle);
+        angleSum += angle;
+    }
+    error.meanNormalAngle = static_cast<float>(angleSum / mesh.positions.size());
+
+    for (const auto& position : reference.positions) {
+        uint32_t nearest = meshLookup.findNearest(position);
+        float distance = nearest == UINT32_MAX ? notFoundDistance
+                                               : glm::distance(position, mesh.positions[nearest]);
+        error.hausdorffDistance = std::max(error.hausdorffDistance, distance);
+    }
+    return error;
+}
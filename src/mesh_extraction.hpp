@@ -0,0 +1,306 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu_pipeline.hpp"
+#include "marching_cubes_table.hpp"
+
+// CPU versions of the extractors in surface.mesh and surface_nets.mesh.
+// Both read the surface blocks, densities and normals computed by CpuPipeline.
+
+struct SurfaceMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec4> attributes;  // empty if the particle attributes are not transferred
+    std::vector<uint32_t> indices;      // triangle list
+
+    size_t getTriangleCount() const { return indices.size() / 3; }
+};
+
+enum class Extractor
+{
+    MarchingCubes,
+    SurfaceNets,
+};
+
+// Same as computeInterpolationFactor() in marching_cubes_table.glsl
+inline float computeInterpolationFactor(float dens0, float dens1, float isoValue)
+{
+    if (std::abs(dens0 - isoValue) < 0.00001f && std::abs(dens1 - isoValue) < 0.00001f) {
+        return 0.5f;
+    }
+    if (std::abs(dens0 - dens1) > 0.00001f) {
+        return glm::clamp((isoValue - dens0) / (dens1 - dens0), 0.0f, 1.0f);
+    }
+    return dens0 < isoValue ? 1.0f : 0.0f;
+}
+
+// Position, normal and attribute of the surface crossing on the grid edge from vertex0 to
+// vertex1
+inline void computeEdgeCrossing(const CpuPipeline& pipeline,
+                                const glm::uvec3& vertex0,
+                                const glm::uvec3& vertex1,
+                                float isoValue,
+                                glm::vec3& position,
+                                glm::vec3& normal,
+                                glm::vec4& attribute)
+{
+    float t = computeInterpolationFactor(pipeline.getDensity(vertex0),
+                                         pipeline.getDensity(vertex1), isoValue);
+    glm::vec3 pos = glm::mix(glm::vec3(vertex0), glm::vec3(vertex1), t);
+    position = pipeline.getGridOrigin() + pipeline.getCellSize() * pos;
+
+    glm::vec3 normal0 = glm::vec3(pipeline.cellVertexNormals[to1D(vertex0, N + 1)]);
+    glm::vec3 normal1 = glm::vec3(pipeline.cellVertexNormals[to1D(vertex1, N + 1)]);
+    normal = -glm::normalize(glm::mix(normal0, normal1, t));
+    attribute = pipeline.interpolateVertexAttribute(to1D(vertex0, N + 1), to1D(vertex1, N + 1), t);
+}
+
+inline uint32_t computeMarchingCubesCase(const CpuPipeline& pipeline,
+                                         const glm::uvec3& cellIndices,
+                                         float isoValue)
+{
+    uint32_t mcCase = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        glm::uvec3 offset{vertexIndexToOffset[i][0], vertexIndexToOffset[i][1],
+                          vertexIndexToOffset[i][2]};
+        mcCase |= uint32_t(pipeline.getDensity(cellIndices + offset) > isoValue) << i;
+    }
+    return mcCase;
+}
+
+// Min and max density of the corners of a cell.
+// The cell crosses the iso surface of isoValue only if min <= isoValue < max.
+inline glm::vec2 getCellDensityRange(const CpuPipeline& pipeline, const glm::uvec3& cellIndices)
+{
+    glm::vec2 range{FLT_MAX, -FLT_MAX};
+    for (uint32_t i = 0; i < 8; i++) {
+        glm::uvec3 offset{vertexIndexToOffset[i][0], vertexIndexToOffset[i][1],
+                          vertexIndexToOffset[i][2]};
+        float density = pipeline.getDensity(cellIndices + offset);
+        range = {std::min(range.x, density), std::max(range.y, density)};
+    }
+    return range;
+}
+
+// Calls func(cellIndices) for each cell of the surface blocks
+template <typename Func>
+void forEachSurfaceBlockCell(const CpuPipeline& pipeline, Func&& func)
+{
+    for (uint32_t blockIndex : pipeline.surfaceBlocks) {
+        glm::uvec3 blockIndices = to3D(blockIndex, M);
+        for (uint32_t localCellIndex = 0; localCellIndex < KC; localCellIndex++) {
+            func(blockIndices * glm::uvec3(K) + to3D(localCellIndex, K));
+        }
+    }
+}
+
+// The extractors take the cells one by one, so that several iso values share a pass over the
+// densities. A cell that does not cross the surface adds nothing and may be skipped.
+
+// Marching cubes: a vertex on each grid edge crossing the surface, up to 5 triangles per cell
+class MarchingCubesExtractor {
+public:
+    MarchingCubesExtractor(const CpuPipeline& pipeline, float isoValue)
+        : pipeline{pipeline}, isoValue{isoValue}
+    {
+    }
+
+    void addCell(const glm::uvec3& cellIndices)
+    {
+        const PackedTriangles& triangles
+            = packedTriangleTable[computeMarchingCubesCase(pipeline, cellIndices, isoValue)];
+        for (uint32_t i = 0; i < getPackedTriangleCount(triangles) * 3; i++) {
+            mesh.indices.push_back(getEdgeVertex(cellIndices, getPackedTriangleEdge(triangles, i)));
+        }
+    }
+
+    SurfaceMesh mesh;
+
+private:
+    uint32_t getEdgeVertex(const glm::uvec3& cellIndices, uint32_t edgeIndex)
+    {
+        const CellEdge& edge = cellEdges[edgeIndex];
+        glm::uvec3 start = cellIndices + glm::uvec3(edge.start[0], edge.start[1], edge.start[2]);
+        uint32_t axis = edge.axis;
+        uint64_t key = uint64_t(to1D(start, N + 1)) * 3 + axis;
+
+        auto [it, inserted] = edgeVertices.try_emplace(key, mesh.positions.size());
+        if (inserted) {
+            glm::uvec3 end = start;
+            end[axis]++;
+            glm::vec3 position, normal;
+            glm::vec4 attribute;
+            computeEdgeCrossing(pipeline, start, end, isoValue, position, normal, attribute);
+            mesh.positions.push_back(position);
+            mesh.normals.push_back(normal);
+            if (pipeline.transfersAttributes()) {
+                mesh.attributes.push_back(attribute);
+            }
+        }
+        return it->second;
+    }
+
+    const CpuPipeline& pipeline;
+    float isoValue;
+    std::unordered_map<uint64_t, uint32_t> edgeVertices;  // start vertex * 3 + axis
+};
+
+// Naive surface nets: a vertex in each cell crossing the surface,
+// placed at the average of the crossings on its edges.
+// Each grid edge crossing the surface is connected to a quad of the four cells around it.
+class SurfaceNetsExtractor {
+public:
+    SurfaceNetsExtractor(const CpuPipeline& pipeline, float isoValue)
+        : pipeline{pipeline}, isoValue{isoValue}
+    {
+    }
+
+    // The edge starting at the min vertex of a cell belongs to that cell
+    void addCell(const glm::uvec3& cellIndices)
+    {
+        for (int axis = 0; axis < 3; axis++) {
+            int axis1 = (axis + 1) % 3;
+            int axis2 = (axis + 2) % 3;
+            if (cellIndices[axis1] == 0 || cellIndices[axis2] == 0) {
+                continue;
+            }
+            glm::uvec3 end = cellIndices;
+            end[axis]++;
+            bool inside0 = pipeline.getDensity(cellIndices) > isoValue;
+            bool inside1 = pipeline.getDensity(end) > isoValue;
+            if (inside0 == inside1) {
+                continue;
+            }
+
+            // Cells around the edge, counterclockwise seen from the end of the edge
+            glm::uvec3 offset1{0}, offset2{0};
+            offset1[axis1] = 1;
+            offset2[axis2] = 1;
+            int32_t quad[4] = {getCellVertex(cellIndices - offset1 - offset2),
+                               getCellVertex(cellIndices - offset2),
+                               getCellVertex(cellIndices),
+                               getCellVertex(cellIndices - offset1)};
+
+            // Face towards the outside of the fluid
+            if (!inside0) {
+                std::swap(quad[1], quad[3]);
+            }
+            for (int i : {0, 1, 2, 0, 2, 3}) {
+                mesh.indices.push_back(static_cast<uint32_t>(quad[i]));
+            }
+        }
+    }
+
+    SurfaceMesh mesh;
+
+private:
+    int32_t getCellVertex(const glm::uvec3& cellIndices)
+    {
+        auto [it, inserted] = cellVertices.try_emplace(to1D(cellIndices, N), -1);
+        if (!inserted) {
+            return it->second;
+        }
+        uint32_t mcCase = computeMarchingCubesCase(pipeline, cellIndices, isoValue);
+        if (mcCase == 0 || mcCase == 255) {
+            return it->second;
+        }
+
+        glm::vec3 position{0.0f};
+        glm::vec3 normal{0.0f};
+        glm::vec4 attribute{0.0f};
+        uint32_t crossingCount = 0;
+        for (int edgeIndex = 0; edgeIndex < 12; edgeIndex++) {
+            uint32_t i0 = edgeVertexIndices[edgeIndex][0];
+            uint32_t i1 = edgeVertexIndices[edgeIndex][1];
+            if (((mcCase >> i0) & 1) == ((mcCase >> i1) & 1)) {
+                continue;
+            }
+            const uint32_t* v0 = vertexIndexToOffset[i0];
+            const uint32_t* v1 = vertexIndexToOffset[i1];
+            glm::vec3 edgePosition, edgeNormal;
+            glm::vec4 edgeAttribute;
+            computeEdgeCrossing(pipeline, cellIndices + glm::uvec3(v0[0], v0[1], v0[2]),
+                                cellIndices + glm::uvec3(v1[0], v1[1], v1[2]), isoValue,
+                                edgePosition, edgeNormal, edgeAttribute);
+            position += edgePosition;
+            normal += edgeNormal;
+            attribute += edgeAttribute;
+            crossingCount++;
+        }
+        it->second = static_cast<int32_t>(mesh.positions.size());
+        mesh.positions.push_back(position / static_cast<float>(crossingCount));
+        mesh.normals.push_back(glm::normalize(normal));
+        if (pipeline.transfersAttributes()) {
+            mesh.attributes.push_back(attribute / static_cast<float>(crossingCount));
+        }
+        return it->second;
+    }
+
+    const CpuPipeline& pipeline;
+    float isoValue;
+    std::unordered_map<uint32_t, int32_t> cellVertices;
+};
+
+// One pass over the cells of the surface blocks for all iso values.
+// The densities of a cell are read once to skip the iso values it does not cross.
+template <typename CellExtractor>
+std::vector<SurfaceMesh> extractIsoSurfaces(const CpuPipeline& pipeline,
+                                            std::span<const float> isoValues)
+{
+    std::vector<CellExtractor> extractors;
+    for (float isoValue : isoValues) {
+        extractors.emplace_back(pipeline, isoValue);
+    }
+    forEachSurfaceBlockCell(pipeline, [&](const glm::uvec3& cellIndices) {
+        glm::vec2 range = getCellDensityRange(pipeline, cellIndices);
+        for (size_t i = 0; i < extractors.size(); i++) {
+            if (range.x <= isoValues[i] && isoValues[i] < range.y) {
+                extractors[i].addCell(cellIndices);
+            }
+        }
+    });
+
+    std::vector<SurfaceMesh> meshes;
+    for (CellExtractor& extractor : extractors) {
+        meshes.push_back(std::move(extractor.mesh));
+    }
+    return meshes;
+}
+
+// A mesh per iso value, in the order of isoValues, from the densities of a single run.
+// The surface blocks do not depend on the iso value. With unorm16 densities, the pipeline
+// must run with the largest iso value so that the stored range covers all of them.
+inline std::vector<SurfaceMesh> extractSurfaces(const CpuPipeline& pipeline,
+                                                Extractor extractor,
+                                                std::span<const float> isoValues)
+{
+    return extractor == Extractor::SurfaceNets
+               ? extractIsoSurfaces<SurfaceNetsExtractor>(pipeline, isoValues)
+               : extractIsoSurfaces<MarchingCubesExtractor>(pipeline, isoValues);
+}
+
+inline SurfaceMesh extractMarchingCubes(const CpuPipeline& pipeline)
+{
+    float isoValue = pipeline.particleSet.isoValue;
+    return std::move(extractIsoSurfaces<MarchingCubesExtractor>(pipeline, {&isoValue, 1})[0]);
+}
+
+inline SurfaceMesh extractSurfaceNets(const CpuPipeline& pipeline)
+{
+    float isoValue = pipeline.particleSet.isoValue;
+    return std::move(extractIsoSurfaces<SurfaceNetsExtractor>(pipeline, {&isoValue, 1})[0]);
+}
+
+inline SurfaceMesh extractSurface(const CpuPipeline& pipeline, Extractor extractor)
+{
+    return extractor == Extractor::SurfaceNets ? extractSurfaceNets(pipeline)
+                                               : extractMarchingCubes(pipeline);
+}
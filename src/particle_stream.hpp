@@ -0,0 +1,280 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Live particle frames from a simulator process through a POSIX shared memory ring.
+//
+// The producer writes each frame into a free slot and publishes it as the latest frame.
+// The consumer takes the latest frame and reads it in place, skipping the frames it was too
+// slow for. Neither side waits for the other: the consumer marks the slots it reads in the
+// header, and the producer writes to any other slot that is not the latest one.
+//
+// Slot claims follow Dekker's protocol. The producer marks the slot as being written and then
+// reads the consumer's claims, and the consumer claims the slot and then reads its state, both
+// sequentially consistent, so at least one of them sees the other.
+
+struct StreamFrame
+{
+    std::span<const glm::vec4> particles;  // w must be 0: the particle set index
+    uint64_t index = 0;                    // frames published before this one
+    float time = 0.0f;                     // simulation time given by the producer
+};
+
+class ParticleStreamMapping {
+public:
+    // The consumer holds one slot and claims one more while taking the latest frame,
+    // and the producer never overwrites the latest frame
+    static constexpr uint32_t minSlotCount = 4;
+
+    ParticleStreamMapping(const ParticleStreamMapping&) = delete;
+    ParticleStreamMapping& operator=(const ParticleStreamMapping&) = delete;
+
+    uint32_t getSlotCount() const { return getHeader()->slotCount; }
+
+    uint32_t getMaxParticleCount() const { return getHeader()->maxParticleCount; }
+
+protected:
+    static constexpr uint32_t magic = 0x50525354;  // "PRST"
+    static constexpr uint32_t noSlot = UINT32_MAX;
+
+    struct Header
+    {
+        uint32_t magic = 0;
+        uint32_t slotCount = 0;
+        uint32_t maxParticleCount = 0;
+        std::atomic<uint32_t> latestSlot{noSlot};
+        std::atomic<uint32_t> heldSlot{noSlot};       // read by the consumer
+        std::atomic<uint32_t> claimedSlot{noSlot};    // being validated by the consumer
+        std::atomic<uint64_t> publishedFrameCount{0};
+    };
+
+    struct Slot
+    {
+        // 2 * frame + 1 while the frame is written, 2 * frame + 2 once it is published
+        std::atomic<uint64_t> sequence{0};
+        uint32_t particleCount = 0;
+        float time = 0.0f;
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+    static_assert(sizeof(Header) % alignof(glm::vec4) == 0);
+    static_assert(sizeof(Slot) % alignof(glm::vec4) == 0);
+
+    ParticleStreamMapping() = default;
+
+    ~ParticleStreamMapping()
+    {
+#if defined(__unix__)
+        if (data) {
+            munmap(data, size);
+        }
+#endif
+    }
+
+    // Shared memory objects are named "/name"
+    static std::string getObjectName(const std::string& name)
+    {
+        return name.starts_with('/') ? name : "/" + name;
+    }
+
+    static size_t getMappingSize(uint32_t slotCount, uint32_t maxParticleCount)
+    {
+        return sizeof(Header) + sizeof(Slot) * slotCount
+               + sizeof(glm::vec4) * uint64_t(maxParticleCount) * slotCount;
+    }
+
+    void map(const std::string& name, bool create, uint32_t slotCount, uint32_t maxParticleCount)
+    {
+#if defined(__unix__)
+        std::string objectName = getObjectName(name);
+        int flags = create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR;
+        int fd = shm_open(objectName.c_str(), flags, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open the particle stream " + name);
+        }
+        if (create) {
+            size = getMappingSize(slotCount, maxParticleCount);
+            if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                close(fd);
+                shm_unlink(objectName.c_str());
+                throw std::runtime_error("Failed to size the particle stream " + name);
+            }
+        } else {
+            // The size is known after the header is read
+            Header header;
+            if (pread(fd, &header, sizeof(Header), 0) != sizeof(Header)
+                || header.magic != magic) {
+                close(fd);
+                throw std::runtime_error("Not a particle stream: " + name);
+            }
+            size = getMappingSize(header.slotCount, header.maxParticleCount);
+        }
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            data = nullptr;
+            throw std::runtime_error("Failed to map the particle stream " + name);
+        }
+#else
+        throw std::runtime_error("Particle streams need POSIX shared memory");
+#endif
+    }
+
+    Header* getHeader() const { return static_cast<Header*>(data); }
+
+    Slot* getSlot(uint32_t slot) const
+    {
+        return reinterpret_cast<Slot*>(static_cast<char*>(data) + sizeof(Header)) + slot;
+    }
+
+    glm::vec4* getParticles(uint32_t slot) const
+    {
+        auto* particles = reinterpret_cast<glm::vec4*>(getSlot(getSlotCount()));
+        return particles + uint64_t(getMaxParticleCount()) * slot;
+    }
+
+    void* data = nullptr;
+    size_t size = 0;
+};
+
+// Producer side, e.g. in the simulator. Creates the stream and removes it when destroyed.
+class ParticleStreamWriter : public ParticleStreamMapping {
+public:
+    ParticleStreamWriter(const std::string& name,
+                         uint32_t maxParticleCount,
+                         uint32_t slotCount = minSlotCount)
+        : name{name}
+    {
+        if (slotCount < minSlotCount) {
+            throw std::runtime_error("A particle stream needs at least 4 slots");
+        }
+        map(name, true, slotCount, maxParticleCount);
+        Header* header = new (data) Header{};
+        for (uint32_t i = 0; i < slotCount; i++) {
+            new (getSlot(i)) Slot{};
+        }
+        header->slotCount = slotCount;
+        header->maxParticleCount = maxParticleCount;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = magic;
+    }
+
+    ~ParticleStreamWriter()
+    {
+#if defined(__unix__)
+        shm_unlink(getObjectName(name).c_str());
+#endif
+    }
+
+    // Memory of the next frame, to be filled before endFrame()
+    std::span<glm::vec4> beginFrame()
+    {
+        Header* header = getHeader();
+        uint32_t latest = header->latestSlot.load(std::memory_order_relaxed);
+        for (uint32_t i = 1; i <= getSlotCount(); i++) {
+            uint32_t slot = (writeSlot + i) % getSlotCount();
+            if (slot == latest) {
+                continue;
+            }
+            std::atomic<uint64_t>& sequence = getSlot(slot)->sequence;
+            uint64_t previous = sequence.load(std::memory_order_relaxed);
+            sequence.store(2 * frameCount + 1, std::memory_order_seq_cst);
+            if (header->heldSlot.load(std::memory_order_seq_cst) == slot
+                || header->claimedSlot.load(std::memory_order_seq_cst) == slot) {
+                sequence.store(previous, std::memory_order_relaxed);
+                continue;
+            }
+            writeSlot = slot;
+            return {getParticles(slot), getMaxParticleCount()};
+        }
+        // Unreachable with minSlotCount slots
+        throw std::runtime_error("No free slot in the particle stream");
+    }
+
+    // Publish the first particleCount particles of the frame as the latest frame
+    void endFrame(uint32_t particleCount, float time)
+    {
+        Slot* slot = getSlot(writeSlot);
+        slot->particleCount = std::min(particleCount, getMaxParticleCount());
+        slot->time = time;
+        slot->sequence.store(2 * frameCount + 2, std::memory_order_release);
+        getHeader()->latestSlot.store(writeSlot, std::memory_order_release);
+        getHeader()->publishedFrameCount.store(++frameCount, std::memory_order_release);
+    }
+
+private:
+    std::string name;
+    uint32_t writeSlot = 0;
+    uint64_t frameCount = 0;
+};
+
+// Consumer side. The particles are read in place from the shared memory.
+class ParticleStreamReader : public ParticleStreamMapping {
+public:
+    explicit ParticleStreamReader(const std::string& name) { map(name, false, 0, 0); }
+
+    ~ParticleStreamReader()
+    {
+        if (data) {
+            getHeader()->heldSlot.store(noSlot, std::memory_order_seq_cst);
+        }
+    }
+
+    // Take the latest frame if it is newer than the current one.
+    // The current frame stays valid until a newer frame is taken.
+    bool update()
+    {
+        Header* header = getHeader();
+        uint64_t published = header->publishedFrameCount.load(std::memory_order_acquire);
+        if (published == 0 || (hasFrame && published == frame.index + 1)) {
+            return false;
+        }
+
+        // Another frame may be published while the slot is claimed, so retry a few times
+        for (int attempt = 0; attempt < 4; attempt++) {
+            uint32_t slot = header->latestSlot.load(std::memory_order_acquire);
+            header->claimedSlot.store(slot, std::memory_order_seq_cst);
+            uint64_t sequence = getSlot(slot)->sequence.load(std::memory_order_seq_cst);
+            if (sequence == 0 || sequence % 2 == 1) {
+                continue;
+            }
+            uint64_t index = sequence / 2 - 1;
+            if (hasFrame && index <= frame.index) {
+                break;
+            }
+
+            header->heldSlot.store(slot, std::memory_order_seq_cst);
+            header->claimedSlot.store(noSlot, std::memory_order_seq_cst);
+            droppedFrameCount += hasFrame ? index - frame.index - 1 : 0;
+            frame.particles = {getParticles(slot), getSlot(slot)->particleCount};
+            frame.index = index;
+            frame.time = getSlot(slot)->time;
+            hasFrame = true;
+            return true;
+        }
+        header->claimedSlot.store(noSlot, std::memory_order_seq_cst);
+        return false;
+    }
+
+    // Empty until the first frame is taken
+    const StreamFrame& getFrame() const { return frame; }
+
+    // Frames published but never taken, because a newer frame was already available
+    uint64_t getDroppedFrameCount() const { return droppedFrameCount; }
+
+private:
+    StreamFrame frame;
+    bool hasFrame = false;
+    uint64_t droppedFrameCount = 0;
+};
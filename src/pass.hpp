@@ -162,3 +162,93 @@ private:
     rv::GraphicsPipelineHandle pipeline;
     Constants constants;
 };
+
+// Depth pyramid of the opaque pass used to cull occluded surface blocks.
+// All levels are packed into one buffer, from the full resolution down to 1x1.
+class HiZPass {
+public:
+    struct Constants
+    {
+        glm::ivec2 srcSize{0, 0};
+        glm::ivec2 dstSize{0, 0};
+        uint32_t srcOffset{0};
+        uint32_t dstOffset{0};
+        uint32_t level{0};
+    };
+
+    void init(const rv::Context& context, rv::ImageHandle depthImage, uint32_t width, uint32_t height)
+    {
+        levelSizes.clear();
+        levelOffsets.clear();
+        glm::ivec2 size{width, height};
+        uint32_t offset = 0;
+        while (true) {
+            levelSizes.push_back(size);
+            levelOffsets.push_back(offset);
+            offset += size.x * size.y;
+            if (size == glm::ivec2{1, 1}) {
+                break;
+            }
+            size = glm::max((size + 1) / 2, glm::ivec2{1, 1});
+        }
+
+        hiZBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Storage,
+            .memory = rv::MemoryUsage::Device,
+            .size = sizeof(float) * offset,
+        });
+
+        rv::ShaderHandle compShader = context.createShader({
+            .code = compileOrLoadShader("hiz.comp"),
+            .stage = vk::ShaderStageFlagBits::eCompute,
+        });
+
+        descSet = context.createDescriptorSet({
+            .shaders = {compShader},
+            .buffers = {{"HiZ", hiZBuffer}},
+            .images = {{"depthImage", depthImage}},
+        });
+        descSet->update();
+
+        pipeline = context.createComputePipeline({
+            .computeShader = compShader,
+            .descSetLayout = descSet->getLayout(),
+            .pushSize = sizeof(Constants),
+        });
+    }
+
+    // depthImage must be readable by shaders
+    void run(const rv::CommandBufferHandle& commandBuffer)
+    {
+        commandBuffer->bindDescriptorSet(descSet, pipeline);
+        commandBuffer->bindPipeline(pipeline);
+        for (uint32_t level = 0; level < levelSizes.size(); level++) {
+            constants.level = level;
+            constants.dstSize = levelSizes[level];
+            constants.dstOffset = levelOffsets[level];
+            if (level > 0) {
+                constants.srcSize = levelSizes[level - 1];
+                constants.srcOffset = levelOffsets[level - 1];
+            }
+            commandBuffer->pushConstants(pipeline, &constants);
+            commandBuffer->dispatch(divRoundUp(constants.dstSize.x, 8),
+                                    divRoundUp(constants.dstSize.y, 8), 1);
+            commandBuffer->bufferBarrier(hiZBuffer,
+                                         vk::PipelineStageFlagBits::eComputeShader,  //
+                                         vk::PipelineStageFlagBits::eComputeShader |
+                                             vk::PipelineStageFlagBits::eTaskShaderEXT,  //
+                                         vk::AccessFlagBits::eShaderWrite,               //
+                                         vk::AccessFlagBits::eShaderRead);
+        }
+    }
+
+    rv::BufferHandle getBuffer() const { return hiZBuffer; }
+
+private:
+    rv::BufferHandle hiZBuffer;
+    rv::DescriptorSetHandle descSet;
+    rv::ComputePipelineHandle pipeline;
+    Constants constants;
+    std::vector<glm::ivec2> levelSizes;
+    std::vector<uint32_t> levelOffsets;
+};
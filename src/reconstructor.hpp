@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../shader/shared.inc"
+#include "domain.hpp"
+#include "mesh_extraction.hpp"
+
+// Reconstruction API of the surface_reconstruction library, for embedding in other processes.
+// It depends only on glm: the particles are passed in memory and the mesh is returned in memory.
+
+struct ReconstructionParams
+{
+    float isoValue{0.03f};
+    float kernelRadius{cellSize.x * 0.99f};
+    float kernelScale{15.0f};
+    Extractor extractor = Extractor::MarchingCubes;
+    uint32_t storageFormat{densityFloat32};
+
+    // Particles with fewer neighbors in the cells around them are returned as spray instead
+    // of being meshed. Disabled if zero.
+    uint32_t sprayNeighborCount{0};
+
+    // The surface blocks, cells and vertices are compacted in block order instead of the order
+    // in which the threads append them, so that identical particles give identical meshes.
+    // Costs the copy of the per-thread lists.
+    bool orderedCompaction = false;
+
+    // Evaluate all the vertices of the surface blocks (see Reconstruction::blockDensities)
+    bool evaluateBlocks = false;
+
+    // The grid covers gridOrigin (xyz: origin, w: cell size), or the bounds of the particles
+    bool fitGridToParticles = false;
+    glm::vec4 gridOrigin{areaOrigin, cellSize.x};
+
+    // If not empty, a mesh is extracted for each of these iso values instead of isoValue,
+    // all from the same densities (see Reconstruction::isoSurfaces)
+    std::vector<float> isoSweep;
+};
+
+struct IsoSurface
+{
+    float isoValue = 0.0f;
+    SurfaceMesh mesh;
+};
+
+struct Reconstruction
+{
+    SurfaceMesh mesh;                     // empty for an iso sweep
+    std::vector<IsoSurface> isoSurfaces;  // in the order of ReconstructionParams::isoSweep
+    glm::vec4 gridOrigin{0.0f};           // grid that was used, as in ReconstructionParams
+
+    // Densities of the grid vertices near the surface. The other vertices are not evaluated.
+    std::vector<uint32_t> surfaceVertices;  // to1D(vertex, N + 1)
+    std::vector<float> surfaceDensities;
+
+    std::vector<uint32_t> surfaceBlocks;  // to1D(block, M)
+    // Densities of all the vertices of each surface block, KV per block with x fastest,
+    // if ReconstructionParams::evaluateBlocks is set
+    std::vector<float> blockDensities;
+    std::vector<glm::vec4> sprayParticles;
+    // Kernel-weighted attribute averages of surfaceVertices if attributes were given
+    std::vector<glm::vec4> surfaceAttributes;
+    size_t surfaceBlockCount = 0;
+    size_t surfaceCellCount = 0;
+};
+
+// Runs the stages of compute.comp and an extractor for one particle set.
+// If isoValues is not empty, the extractor runs for each of them instead of particleSet.isoValue.
+// attributes is empty or has one attribute per particle (see transferAttributes).
+// If evaluateBlocks is set, Reconstruction::blockDensities is filled.
+class ReconstructionBackend {
+public:
+    virtual ~ReconstructionBackend() = default;
+
+    virtual void reconstruct(std::span<const glm::vec4> particles,
+                             std::span<const glm::vec4> attributes,
+                             const GridConstants& constants,
+                             const ParticleSetParams& particleSet,
+                             Extractor extractor,
+                             std::span<const float> isoValues,
+                             bool evaluateBlocks,
+                             Reconstruction& result) = 0;
+};
+
+class CpuBackend : public ReconstructionBackend {
+public:
+    explicit CpuBackend(uint32_t threadCount = std::thread::hardware_concurrency())
+        : pipeline{threadCount}
+    {
+    }
+
+    void reconstruct(std::span<const glm::vec4> particles,
+                     std::span<const glm::vec4> attributes,
+                     const GridConstants& constants,
+                     const ParticleSetParams& particleSet,
+                     Extractor extractor,
+                     std::span<const float> isoValues,
+                     bool evaluateBlocks,
+                     Reconstruction& result) override
+    {
+        pipeline.run(particles.data(), static_cast<uint32_t>(particles.size()), constants,
+                     particleSet, attributes.empty() ? nullptr : attributes.data());
+        result.mesh = {};
+        result.isoSurfaces.clear();
+        if (isoValues.empty()) {
+            result.mesh = extractSurface(pipeline, extractor);
+        } else {
+            std::vector<SurfaceMesh> meshes = extractSurfaces(pipeline, extractor, isoValues);
+            for (size_t i = 0; i < isoValues.size(); i++) {
+                result.isoSurfaces.push_back({isoValues[i], std::move(meshes[i])});
+            }
+        }
+        result.surfaceVertices = pipeline.compressedVertices;
+        result.surfaceDensities.resize(pipeline.compressedVertices.size());
+        for (size_t i = 0; i < pipeline.compressedVertices.size(); i++) {
+            result.surfaceDensities[i] = pipeline.densities[pipeline.compressedVertices[i]];
+        }
+        result.surfaceAttributes.clear();
+        if (pipeline.transfersAttributes()) {
+            for (uint32_t vertexIndex : pipeline.compressedVertices) {
+                result.surfaceAttributes.push_back(pipeline.vertexAttributes[vertexIndex]);
+            }
+        }
+        result.surfaceBlocks = pipeline.surfaceBlocks;
+        result.blockDensities.clear();
+        if (evaluateBlocks) {
+            result.blockDensities = pipeline.evaluateBlockDensities();
+        }
+        result.sprayParticles.clear();
+        for (uint32_t particleIndex : pipeline.sprayParticles) {
+            result.sprayParticles.push_back(particles[particleIndex]);
+        }
+        result.surfaceBlockCount = pipeline.surfaceBlocks.size();
+        result.surfaceCellCount = pipeline.surfaceCells.size();
+    }
+
+private:
+    CpuPipeline pipeline;
+};
+
+class Reconstructor {
+public:
+    explicit Reconstructor(std::unique_ptr<ReconstructionBackend> backend
+                           = std::make_unique<CpuBackend>())
+        : backend{std::move(backend)}
+    {
+    }
+
+    // The particles are not copied and must stay alive until reconstruct() returns.
+    // Particles outside the grid are ignored.
+    // If attributes are given, one per particle (xyz: velocity, w: a scalar such as foam or
+    // age), they are averaged with the kernel weights into SurfaceMesh::attributes.
+    void setParticles(std::span<const glm::vec4> particles,
+                      std::span<const glm::vec4> attributes = {})
+    {
+        if (!attributes.empty() && attributes.size() != particles.size()) {
+            throw std::runtime_error("The particles and their attributes differ in count");
+        }
+        this->particles = particles;
+        this->attributes = attributes;
+    }
+
+    void setParams(const ReconstructionParams& params) { this->params = params; }
+
+    const ReconstructionParams& getParams() const { return params; }
+
+    const Reconstruction& reconstruct()
+    {
+        ParticleSetParams particleSet;
+        particleSet.isoValue = params.isoValue;
+        particleSet.kernelRadius = params.kernelRadius;
+        particleSet.kernelScale = params.kernelScale;
+
+        GridConstants constants;
+        constants.storageFormat = params.storageFormat;
+        constants.sprayNeighborCount = params.sprayNeighborCount;
+        constants.orderedCompaction = params.orderedCompaction ? 1 : 0;
+        constants.transferAttributes = attributes.empty() ? 0 : 1;
+        constants.gridOrigin = params.gridOrigin;
+        if (params.fitGridToParticles) {
+            ParticleBounds bounds = computeParticleBounds(
+                particles.data(), static_cast<uint32_t>(particles.size()),
+                std::thread::hardware_concurrency());
+            constants.gridOrigin = fitGridToBounds(bounds, params.kernelRadius);
+        }
+
+        // The unorm16 densities of a sweep cover the largest iso value
+        if (!params.isoSweep.empty()) {
+            particleSet.isoValue
+                = *std::max_element(params.isoSweep.begin(), params.isoSweep.end());
+        }
+
+        result.gridOrigin = constants.gridOrigin;
+        backend->reconstruct(particles, attributes, constants, particleSet, params.extractor,
+                             params.isoSweep, params.evaluateBlocks, result);
+        return result;
+    }
+
+private:
+    std::unique_ptr<ReconstructionBackend> backend;
+    std::span<const glm::vec4> particles;
+    std::span<const glm::vec4> attributes;
+    ReconstructionParams params;
+    Reconstruction result;
+};
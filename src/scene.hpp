@@ -1,16 +1,25 @@
 #pragma once
 #include <Alembic/AbcCoreFactory/All.h>
 #include <Alembic/AbcGeom/All.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
 #include <glm/glm.hpp>
+#include <map>
 #include <vector>
 
+#include "interpolation.hpp"
+
 using namespace Alembic::Abc;
 using namespace Alembic::AbcGeom;
 
 class Scene {
 public:
-    void load(const std::string& filepath)
+    // Streaming: particle samples are decoded when they are evaluated instead of at load time
+    void load(const std::string& filepath, bool streaming = false)
     {
+        streamParticles = streaming;
         if (!std::filesystem::exists(filepath)) {
             std::cout << "ERROR: file not found: " << filepath << std::endl;
             return;
@@ -25,6 +34,17 @@ public:
         visitObject(archive.getTop());
     }
 
+    static glm::mat4 toMat4(const Imath::M44d& alembicMatrix)
+    {
+        glm::mat4 transform = glm::mat4(1.0f);
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                transform[i][j] = static_cast<float>(alembicMatrix[i][j]);
+            }
+        }
+        return transform;
+    }
+
     // トランスフォームを取得する関数
     glm::mat4 getTransform(const IObject& obj) const
     {
@@ -33,14 +53,7 @@ public:
             XformSample sample;
             xform.getSchema().get(sample);
 
-            const auto& alembicMatrix = sample.getMatrix();
-            glm::mat4 transform = glm::mat4(1.0f);
-            for (int i = 0; i < 4; i++) {
-                for (int j = 0; j < 4; j++) {
-                    transform[i][j] = static_cast<float>(alembicMatrix[i][j]);
-                }
-            }
-
+            glm::mat4 transform = toMat4(sample.getMatrix());
             std::cout << glm::to_string(transform) << "\n";
             return transform;
         }
@@ -48,9 +61,11 @@ public:
         return glm::mat4{1.0f};  // 単位行列を返す
     }
 
+    // Colliders are kept indexed in one vertex/index arena and drawn with a single draw.
+    // Faces are triangulated as fans. Vertices are split only where the normals differ.
     void processMesh(const IPolyMesh& meshObj)
     {
-        if (meshObj.getFullName().find("Effector") == std::string::npos) {
+        if (meshObj.getFullName().find(colliderFilter) == std::string::npos) {
             return;
         }
 
@@ -61,63 +76,94 @@ public:
         if (numSamples == 0)
             return;
 
-        // 最初のサンプルのみを処理（複数サンプルの処理が必要な場合はループを使用）
+        Collider collider;
+        collider.name = meshObj.getFullName();
+        collider.schema = schema;
+        collider.normalsParam = schema.getNormalsParam();
+        collider.firstVertex = static_cast<uint32_t>(colliderVertices.size());
+        collider.firstIndex = static_cast<uint32_t>(colliderIndices.size());
+        collider.transform = getTransform(meshObj.getParent());
+        if (IXform::matches(meshObj.getParent().getMetaData())) {
+            collider.xformSchema = IXform(meshObj.getParent(), kWrapExisting).getSchema();
+            collider.animatedTransform = !collider.xformSchema.isConstant();
+        }
+
+        // Positions can be updated per sample only if the face indices never change
+        MeshTopologyVariance variance = schema.getTopologyVariance();
+        collider.deforming = variance == kHomogenousTopology;
+        if (variance == kHeterogenousTopology) {
+            std::cout << "WARNING: only the first sample is used: " << collider.name << "\n";
+        }
+
         IPolyMeshSchema::Sample sample;
         schema.get(sample, ISampleSelector(static_cast<index_t>(0)));
-
-        // 頂点の位置を取得
         P3fArraySamplePtr positions = sample.getPositions();
+        Int32ArraySamplePtr faceIndices = sample.getFaceIndices();
+        Int32ArraySamplePtr faceCounts = sample.getFaceCounts();
+        if (!positions || !faceIndices || !faceCounts) {
+            return;
+        }
+
         // 法線を取得（存在する場合）
-        IN3fGeomParam normalsParam = schema.getNormalsParam();
         IN3fGeomParam::Sample normalsSample;
-        if (normalsParam.valid()) {
-            normalsSample = normalsParam.getIndexedValue();
+        bool faceVarying = false;
+        if (collider.normalsParam.valid()) {
+            collider.normalsParam.getIndexed(normalsSample, ISampleSelector(index_t(0)));
+            faceVarying = collider.normalsParam.getScope() == kFacevaryingScope;
         } else {
             std::cout << "This mesh does not have normals\n";
         }
-
-        // Mesh構造体を作成
-        glm::mat4 transform = getTransform(meshObj.getParent());
-        std::vector<Vertex> outVertices;
-        std::vector<uint32_t> outIndices;
-
-        if (positions) {
-            for (size_t i = 0; i < positions->size(); ++i) {
-                Vertex vertex;
-                const Imath::V3f& pos = (*positions)[i];
-                glm::vec4 localPos = glm::vec4(pos.x, pos.y, pos.z, 1.0f);
-                vertex.pos = glm::vec3(transform * localPos);
-                outVertices.push_back(vertex);
+        N3fArraySamplePtr normalValues = normalsSample.getVals();
+        UInt32ArraySamplePtr normalIndices = normalsSample.getIndices();
+
+        // One vertex for each pair of position and normal value
+        std::map<std::array<uint32_t, 4>, uint32_t> vertexIndices;
+        auto getVertex = [&](uint32_t corner) {
+            uint32_t positionIndex = static_cast<uint32_t>((*faceIndices)[corner]);
+            uint32_t normalIndex = UINT32_MAX;
+            glm::vec3 normal{0.0f};
+            if (normalValues && normalIndices) {
+                normalIndex = (*normalIndices)[faceVarying ? corner : positionIndex];
+                const Imath::V3f& value = (*normalValues)[normalIndex];
+                normal = glm::vec3(value.x, value.y, value.z);
             }
-        }
-
-        // インデックスを取得
-        if (Int32ArraySamplePtr indices = sample.getFaceIndices()) {
-            for (int i = 0; i < indices->size(); i++) {
-                const int32_t* data = static_cast<const int32_t*>(indices->getData());
-                outIndices.push_back(static_cast<uint32_t>(data[i]));
+            std::array<uint32_t, 4> key{positionIndex, std::bit_cast<uint32_t>(normal.x),
+                                        std::bit_cast<uint32_t>(normal.y),
+                                        std::bit_cast<uint32_t>(normal.z)};
+            auto [it, inserted] = vertexIndices.try_emplace(
+                key, static_cast<uint32_t>(colliderVertices.size()));
+            if (inserted) {
+                const Imath::V3f& pos = (*positions)[positionIndex];
+                colliderVertices.push_back({
+                    .pos = glm::vec3(pos.x, pos.y, pos.z),
+                    .normal = normal,
+                    .collider = static_cast<uint32_t>(colliders.size()),
+                });
+                collider.positionIndices.push_back(positionIndex);
+                collider.normalIndices.push_back(normalIndex);
             }
-        }
-
-        // Meshを追加
-        Mesh mesh;
-        if (normalsParam.valid()) {
-            // TODO: support indexed normal
-            assert(!normalsSample.isIndexed());
-            for (uint32_t i = 0; i < outIndices.size(); i++) {
-                const Imath::V3f& normal = normalsSample.getVals()->get()[i];
-                Vertex vertex{};
-                vertex.pos = outVertices[outIndices[i]].pos;
-                vertex.normal = glm::vec3(normal.x, normal.y, normal.z);
-                mesh.vertices.push_back(vertex);
-                mesh.indices.push_back(i);
+            return it->second;
+        };
+
+        // Alembic faces are polygons
+        uint32_t faceStart = 0;
+        for (size_t face = 0; face < faceCounts->size(); face++) {
+            uint32_t count = static_cast<uint32_t>((*faceCounts)[face]);
+            for (uint32_t k = 1; k + 1 < count; k++) {
+                colliderIndices.push_back(getVertex(faceStart));
+                colliderIndices.push_back(getVertex(faceStart + k));
+                colliderIndices.push_back(getVertex(faceStart + k + 1));
             }
-        } else {
-            mesh.vertices = outVertices;
-            mesh.indices = outIndices;
+            faceStart += count;
         }
 
-        meshes.push_back(mesh);
+        collider.vertexCount = static_cast<uint32_t>(colliderVertices.size())  //
+                               - collider.firstVertex;
+        collider.indexCount = static_cast<uint32_t>(colliderIndices.size())  //
+                              - collider.firstIndex;
+        std::cout << "  collider vertices: " << collider.vertexCount
+                  << ", indices: " << collider.indexCount << std::endl;
+        colliders.push_back(std::move(collider));
     }
 
     void processPoints(const IPoints& points)
@@ -126,33 +172,67 @@ public:
         IPointsSchema schema = points.getSchema();
 
         // サンプル数を取得
-        frameCount = static_cast<int>(schema.getNumSamples());
-        if (frameCount == 0)
+        int setFrameCount = static_cast<int>(schema.getNumSamples());
+        if (setFrameCount == 0)
             return;
-        std::cout << "  frames: " << frameCount << std::endl;
-        particleCounts.resize(frameCount);
-        particleOffsets.resize(frameCount);
-
-        glm::mat4 transform = getTransform(points.getParent());
+        if (particleSets.size() == maxParticleSets) {
+            std::cout << "WARNING: skipped particle set: " << points.getFullName() << std::endl;
+            return;
+        }
+        std::cout << "  frames: " << setFrameCount << std::endl;
+
+        ParticleSet& set = particleSets.emplace_back();
+        set.name = points.getFullName();
+        set.frameCount = setFrameCount;
+        set.particleCounts.resize(setFrameCount);
+        set.particleOffsets.resize(setFrameCount);
+        set.schema = schema;
+        set.transform = getTransform(points.getParent());
+        set.setIndex = static_cast<float>(particleSets.size() - 1);
+        set.streamed = streamParticles;
+
+        // Velocities and the first scalar attribute found become the particle attributes
+        ICompoundProperty arbGeomParams = schema.getArbGeomParams();
+        for (const std::string& name : scalarAttributeNames) {
+            const PropertyHeader* header
+                = arbGeomParams ? arbGeomParams.getPropertyHeader(name) : nullptr;
+            if (header && IFloatGeomParam::matches(*header)) {
+                set.scalarParam = IFloatGeomParam(arbGeomParams, name);
+                std::cout << "  scalar attribute: " << name << std::endl;
+                break;
+            }
+        }
+        set.hasAttributes = schema.getVelocitiesProperty().valid() || set.scalarParam.valid();
 
         // 各サンプルを処理
-        for (int i = 0; i < frameCount; ++i) {
-            IPointsSchema::Sample sample;
-            schema.get(sample, ISampleSelector((index_t)i));
-
-            // パーティクルの位置を取得
-            P3fArraySamplePtr positions = sample.getPositions();
-            particleCounts[i] = static_cast<uint32_t>(positions->size());
-            particleOffsets[i] = i == 0 ? 0 : particleOffsets[i - 1] + particleCounts[i - 1];
-            std::cout << "  particles: " << positions->size() << std::endl;
-            if (positions) {
-                for (size_t j = 0; j < particleCounts[i]; ++j) {
-                    const Imath::V3f& pos = (*positions)[j];
-                    particles.push_back(transform * glm::vec4(pos.x, pos.y, pos.z, 0.0f));
-                }
+        bool hasIds = true;
+        for (int i = 0; i < setFrameCount; ++i) {
+            if (streamParticles) {
+                // Only the counts are read
+                Dimensions dimensions;
+                schema.getPositionsProperty().getDimensions(dimensions,
+                                                            ISampleSelector((index_t)i));
+                set.particleCounts[i] = static_cast<uint32_t>(dimensions.numPoints());
+            } else {
+                size_t offset = set.particles.size();
+                hasIds = set.decode(i, set.particles, set.ids, set.attributes) && hasIds;
+                set.particleCounts[i] = static_cast<uint32_t>(set.particles.size() - offset);
             }
+            set.particleOffsets[i]
+                = i == 0 ? 0 : set.particleOffsets[i - 1] + set.particleCounts[i - 1];
+            std::cout << "  particles: " << set.particleCounts[i] << std::endl;
+        }
+        if (!hasIds) {
+            set.ids.clear();
+        }
+        set.maxParticleCount = std::ranges::max(set.particleCounts);
+
+        // Sets may have different lengths. A set contributes no particles after its last frame.
+        frameCount = std::max(frameCount, setFrameCount);
+        maxParticleCount = 0;
+        for (int i = 0; i < frameCount; i++) {
+            maxParticleCount = std::max(maxParticleCount, getParticleCount(i));
         }
-        maxParticleCount = std::ranges::max(particleCounts);
     }
 
     void visitObject(const IObject& obj, size_t level = 0)
@@ -173,55 +253,350 @@ public:
         }
     }
 
-    void update() { frame = (frame + 1) % frameCount; }
+    // Read the collider samples of the current frame.
+    // Only transforms and positions whose sample changed are written to the buffers.
+    void updateColliders()
+    {
+        auto* vertices = static_cast<Vertex*>(colliderVertexBuffer->map());
+        auto* transforms = static_cast<glm::mat4*>(colliderTransformBuffer->map());
+        for (auto& collider : colliders) {
+            if (collider.animatedTransform) {
+                index_t sampleIndex = std::min<index_t>(
+                    getFrame(), collider.xformSchema.getNumSamples() - 1);
+                if (sampleIndex != collider.transformSample) {
+                    XformSample sample;
+                    collider.xformSchema.get(sample, ISampleSelector(sampleIndex));
+                    collider.transform = toMat4(sample.getMatrix());
+                    collider.transformSample = sampleIndex;
+                    transforms[&collider - colliders.data()] = collider.transform;
+                }
+            }
+
+            if (collider.deforming) {
+                index_t sampleIndex = std::min<index_t>(getFrame(),
+                                                        collider.schema.getNumSamples() - 1);
+                if (sampleIndex != collider.positionSample) {
+                    collider.readSample(sampleIndex, colliderVertices);
+                    std::memcpy(vertices + collider.firstVertex,
+                                colliderVertices.data() + collider.firstVertex,
+                                sizeof(Vertex) * collider.vertexCount);
+                }
+            }
+        }
+    }
+
+    void allocateColliders(const rv::Context& context)
+    {
+        // Vertices are rewritten in place for deforming colliders
+        colliderVertexBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Vertex,
+            .memory = rv::MemoryUsage::DeviceHost,
+            .size = sizeof(Vertex) * std::max<size_t>(colliderVertices.size(), 1),
+        });
+        colliderIndexBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Index,
+            .memory = rv::MemoryUsage::Device,
+            .size = sizeof(uint32_t) * std::max<size_t>(colliderIndices.size(), 1),
+        });
+        colliderTransformBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Storage,
+            .memory = rv::MemoryUsage::DeviceHost,
+            .size = sizeof(glm::mat4) * std::max<size_t>(colliders.size(), 1),
+        });
+        colliderDrawCommandBuffer = context.createBuffer({
+            .usage = rv::BufferUsage::Indirect,
+            .memory = rv::MemoryUsage::Host,
+            .size = sizeof(vk::DrawIndexedIndirectCommand),
+        });
+
+        if (!colliderVertices.empty()) {
+            std::memcpy(colliderVertexBuffer->map(), colliderVertices.data(),
+                        sizeof(Vertex) * colliderVertices.size());
+        }
+        if (!colliderIndices.empty()) {
+            context.oneTimeSubmit([&](rv::CommandBufferHandle commandBuffer) {
+                commandBuffer->copyBuffer(colliderIndexBuffer, colliderIndices.data());
+            });
+        }
+        auto* transforms = static_cast<glm::mat4*>(colliderTransformBuffer->map());
+        for (size_t i = 0; i < colliders.size(); i++) {
+            transforms[i] = colliders[i].transform;
+        }
 
-    uint32_t getParticleCount() const { return particleCounts[frame]; }
+        // All colliders in a single command
+        vk::DrawIndexedIndirectCommand command;
+        command.setIndexCount(static_cast<uint32_t>(colliderIndices.size()));
+        command.setInstanceCount(1);
+        std::memcpy(colliderDrawCommandBuffer->map(), &command, sizeof(command));
+    }
 
-    uint32_t getSize() const { return sizeof(glm::vec4) * particleCounts[frame]; }
+    // Slow motion if playbackSpeed < 1
+    void update()
+    {
+        time = std::fmod(time + playbackSpeed, static_cast<float>(frameCount));
+    }
 
-    const glm::vec4* getData() const { return particles.data() + particleOffsets[frame]; }
+    int getFrame() const { return static_cast<int>(time); }
 
-    int frame = 0;
-    int frameCount = 0;
-    uint32_t maxParticleCount = 0;
-    std::vector<uint32_t> particleCounts;
-    std::vector<uint32_t> particleOffsets;
-    std::vector<glm::vec4> particles;
+    uint32_t getParticleSetCount() const { return static_cast<uint32_t>(particleSets.size()); }
 
-    struct Vertex
+    // Total of all sets
+    uint32_t getParticleCount(int frameIndex) const
     {
-        glm::vec3 pos;
-        glm::vec3 normal;
-    };
+        uint32_t count = 0;
+        for (const auto& set : particleSets) {
+            count += set.getParticleCount(frameIndex);
+        }
+        return count;
+    }
+
+    uint32_t getParticleCount() const { return getParticleCount(getFrame()); }
 
-    struct Mesh
+    // Append the particles of all sets at a sub-frame time, ordered by set.
+    // w is firstLayer + the index of the set.
+    // If outAttributes is not null, the attributes of the particles are appended to it.
+    void appendParticles(float sampleTime,
+                         uint32_t firstLayer,
+                         std::vector<glm::vec4>& outParticles,
+                         std::vector<glm::vec4>* outAttributes = nullptr) const
     {
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
+        sampleTime = std::fmod(sampleTime, static_cast<float>(frameCount));
+        for (uint32_t i = 0; i < particleSets.size(); i++) {
+            particleSets[i].appendParticles(sampleTime, firstLayer + i, outParticles,
+                                            outAttributes);
+        }
+    }
 
-        rv::BufferHandle vertexBuffer;
-        rv::BufferHandle indexBuffer;
+    // True if a set has velocities or a scalar attribute
+    bool hasParticleAttributes() const
+    {
+        return std::ranges::any_of(particleSets, &ParticleSet::hasAttributes);
+    }
 
-        void allocate(const rv::Context& context)
+    struct ParticleSet
+    {
+        std::string name;
+        int frameCount = 0;
+        uint32_t maxParticleCount = 0;
+        std::vector<uint32_t> particleCounts;
+        std::vector<uint32_t> particleOffsets;
+        std::vector<glm::vec4> particles;  // w: index of the set, empty if streamed
+        std::vector<uint64_t> ids;         // empty if streamed or the cache has no ids
+
+        // Of the particles, empty if streamed or !hasAttributes.
+        // xyz: velocity, w: the scalar attribute, zero where the cache has none.
+        std::vector<glm::vec4> attributes;
+        bool hasAttributes = false;
+
+        IPointsSchema schema;
+        IFloatGeomParam scalarParam;  // invalid if the cache has none of scalarAttributeNames
+        glm::mat4 transform{1.0f};
+        float setIndex = 0.0f;
+
+        // Streaming keeps the two most recently used samples, which bracket the evaluated time
+        struct DecodedSample
         {
-            vertexBuffer = context.createBuffer({
-                .usage = rv::BufferUsage::Vertex,
-                .memory = rv::MemoryUsage::Device,
-                .size = sizeof(Vertex) * vertices.size(),
-            });
+            int frame = -1;
+            uint64_t lastUse = 0;
+            std::vector<glm::vec4> particles;
+            std::vector<uint64_t> ids;
+            std::vector<glm::vec4> attributes;
+            bool hasIds = false;
+        };
+        bool streamed = false;
+        mutable std::array<DecodedSample, 2> decodedSamples;
+        mutable uint64_t useCount = 0;
+
+        uint32_t getParticleCount(int frameIndex) const
+        {
+            return frameIndex < frameCount ? particleCounts[frameIndex] : 0;
+        }
 
-            indexBuffer = context.createBuffer({
-                .usage = rv::BufferUsage::Index,
-                .memory = rv::MemoryUsage::Device,
-                .size = sizeof(uint32_t) * indices.size(),
-            });
+        // Decode a sample and append it. Returns false if the sample has no ids.
+        // The attributes are appended only if the set has attributes.
+        bool decode(int frameIndex,
+                    std::vector<glm::vec4>& outParticles,
+                    std::vector<uint64_t>& outIds,
+                    std::vector<glm::vec4>& outAttributes) const
+        {
+            IPointsSchema::Sample sample;
+            schema.get(sample, ISampleSelector((index_t)frameIndex));
 
-            context.oneTimeSubmit([&](rv::CommandBufferHandle commandBuffer) {
-                commandBuffer->copyBuffer(vertexBuffer, vertices.data());
-                commandBuffer->copyBuffer(indexBuffer, indices.data());
-            });
+            // パーティクルの位置を取得
+            P3fArraySamplePtr positions = sample.getPositions();
+            if (!positions) {
+                return false;
+            }
+            for (size_t j = 0; j < positions->size(); ++j) {
+                const Imath::V3f& pos = (*positions)[j];
+                glm::vec4 particle = transform * glm::vec4(pos.x, pos.y, pos.z, 0.0f);
+                particle.w = setIndex;
+                outParticles.push_back(particle);
+            }
+            if (hasAttributes) {
+                decodeAttributes(frameIndex, sample, positions->size(), outAttributes);
+            }
+
+            UInt64ArraySamplePtr sampleIds = sample.getIds();
+            if (!sampleIds || sampleIds->size() != positions->size()) {
+                return false;
+            }
+            outIds.insert(outIds.end(), sampleIds->get(), sampleIds->get() + sampleIds->size());
+            return true;
+        }
+
+        // Velocities are transformed like the positions. Missing values are zero.
+        void decodeAttributes(int frameIndex,
+                              const IPointsSchema::Sample& sample,
+                              size_t count,
+                              std::vector<glm::vec4>& outAttributes) const
+        {
+            size_t offset = outAttributes.size();
+            outAttributes.resize(offset + count, glm::vec4{0.0f});
+
+            V3fArraySamplePtr velocities = sample.getVelocities();
+            if (velocities && velocities->size() == count) {
+                for (size_t j = 0; j < count; ++j) {
+                    const Imath::V3f& velocity = (*velocities)[j];
+                    glm::vec4 v = transform * glm::vec4(velocity.x, velocity.y, velocity.z, 0.0f);
+                    outAttributes[offset + j] = glm::vec4(glm::vec3(v), 0.0f);
+                }
+            }
+
+            if (scalarParam.valid()) {
+                IFloatGeomParam::Sample scalarSample
+                    = scalarParam.getExpandedValue(ISampleSelector((index_t)frameIndex));
+                FloatArraySamplePtr values = scalarSample.getVals();
+                if (values && values->size() == count) {
+                    for (size_t j = 0; j < count; ++j) {
+                        outAttributes[offset + j].w = (*values)[j];
+                    }
+                }
+            }
         }
+
+        // Interpolate between the samples that bracket sampleTime. w is set to layer.
+        void appendParticles(float sampleTime,
+                             uint32_t layer,
+                             std::vector<glm::vec4>& outParticles,
+                             std::vector<glm::vec4>* outAttributes = nullptr) const
+        {
+            int frame0 = static_cast<int>(sampleTime);
+            if (frame0 >= frameCount) {
+                return;
+            }
+            // The last sample is held instead of blending into the first one
+            int frame1 = std::min(frame0 + 1, frameCount - 1);
+            float t = frame1 == frame0 ? 0.0f : sampleTime - static_cast<float>(frame0);
+            ParticleFrame particleFrame0 = getFrame(frame0);
+            ParticleFrame particleFrame1 = t > 0.0f ? getFrame(frame1) : particleFrame0;
+            interpolateParticles(particleFrame0, particleFrame1, t, static_cast<float>(layer),
+                                 outParticles, outAttributes);
+        }
+
+        // The returned pointers are valid until two other samples are requested
+        ParticleFrame getFrame(int frameIndex) const
+        {
+            if (frameIndex >= frameCount) {
+                return {};
+            }
+            if (!streamed) {
+                uint32_t offset = particleOffsets[frameIndex];
+                return {particles.data() + offset, ids.empty() ? nullptr : ids.data() + offset,
+                        attributes.empty() ? nullptr : attributes.data() + offset,
+                        particleCounts[frameIndex]};
+            }
+
+            auto it = std::ranges::find(decodedSamples, frameIndex, &DecodedSample::frame);
+            if (it == decodedSamples.end()) {
+                it = std::ranges::min_element(decodedSamples, {}, &DecodedSample::lastUse);
+                it->frame = frameIndex;
+                it->particles.clear();
+                it->ids.clear();
+                it->attributes.clear();
+                it->hasIds = decode(frameIndex, it->particles, it->ids, it->attributes);
+            }
+            it->lastUse = ++useCount;
+            return {it->particles.data(), it->hasIds ? it->ids.data() : nullptr,
+                    it->attributes.empty() ? nullptr : it->attributes.data(),
+                    static_cast<uint32_t>(it->particles.size())};
+        }
+    };
+
+    float time = 0.0f;  // frame with a sub-frame fraction
+    float playbackSpeed = 1.0f;
+    int frameCount = 0;
+    uint32_t maxParticleCount = 0;  // of all sets in a frame
+    std::vector<ParticleSet> particleSets;
+    bool streamParticles = false;
+
+    struct Vertex
+    {
+        glm::vec3 pos;  // local space of the collider
+        glm::vec3 normal;
+        uint32_t collider = 0;
     };
 
-    std::vector<Mesh> meshes;
+    struct Collider
+    {
+        std::string name;
+        IPolyMeshSchema schema;
+        IN3fGeomParam normalsParam;
+        IXformSchema xformSchema;  // invalid if the parent is not an IXform
+        glm::mat4 transform{1.0f};
+
+        // Range in the arena
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+
+        // Sources of each vertex in the samples, UINT32_MAX if there is no normal
+        std::vector<uint32_t> positionIndices;
+        std::vector<uint32_t> normalIndices;
+
+        bool deforming = false;  // positions change but the faces do not
+        bool animatedTransform = false;
+        index_t positionSample = 0;
+        index_t transformSample = 0;
+
+        void readSample(index_t sampleIndex, std::vector<Vertex>& vertices)
+        {
+            IPolyMeshSchema::Sample sample;
+            schema.get(sample, ISampleSelector(sampleIndex));
+            P3fArraySamplePtr positions = sample.getPositions();
+            N3fArraySamplePtr normals;
+            if (normalsParam.valid()) {
+                IN3fGeomParam::Sample normalsSample;
+                normalsParam.getIndexed(normalsSample, ISampleSelector(sampleIndex));
+                normals = normalsSample.getVals();
+            }
+            for (uint32_t i = 0; i < vertexCount; i++) {
+                Vertex& vertex = vertices[firstVertex + i];
+                const Imath::V3f& pos = (*positions)[positionIndices[i]];
+                vertex.pos = glm::vec3(pos.x, pos.y, pos.z);
+                if (normals && normalIndices[i] != UINT32_MAX) {
+                    const Imath::V3f& normal = (*normals)[normalIndices[i]];
+                    vertex.normal = glm::vec3(normal.x, normal.y, normal.z);
+                }
+            }
+            positionSample = sampleIndex;
+        }
+    };
+
+    // Only meshes whose names contain this are loaded as colliders
+    std::string colliderFilter = "Effector";
+
+    // Float attributes of the particles, the first found in a set is read into the w of its
+    // particle attributes
+    std::vector<std::string> scalarAttributeNames = {"foam", "age"};
+
+    std::vector<Collider> colliders;
+    std::vector<Vertex> colliderVertices;
+    std::vector<uint32_t> colliderIndices;
+
+    rv::BufferHandle colliderVertexBuffer;
+    rv::BufferHandle colliderIndexBuffer;
+    rv::BufferHandle colliderTransformBuffer;
+    rv::BufferHandle colliderDrawCommandBuffer;
 };
@@ -0,0 +1,193 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../shader/shared.inc"
+#include "reconstructor.hpp"
+
+// Sparse volume files of the surface blocks, for renderers that ray-march the field instead of
+// drawing a mesh. No triangles are generated, and a block takes 512 bytes.
+//
+// Layout, in the byte order of the host:
+//   SparseVolumeHeader
+//   blockCount records of
+//     int32_t x, y, z        block coordinate in the grid of the header
+//     float values[KV]       at the (K + 1)^3 vertices of the block, x fastest
+// Neighboring blocks repeat the values on their shared faces, so that each block is complete.
+
+enum class SparseVolumeValue : uint32_t
+{
+    Density,
+    Distance,  // signed distance to the iso surface, negative inside, clamped to the band
+};
+
+struct SparseVolumeHeader
+{
+    static constexpr uint32_t currentMagic = 0x4c565053;  // "SPVL"
+    static constexpr uint32_t currentVersion = 1;
+
+    uint32_t magic = currentMagic;
+    uint32_t version = currentVersion;
+    uint32_t blockResolution = K;  // cells per block axis
+    SparseVolumeValue valueType = SparseVolumeValue::Density;
+    glm::vec4 gridOrigin{areaOrigin, cellSize.x};  // xyz: origin, w: cell size
+    float isoValue = 0.0f;
+    float bandWidth = 0.0f;  // in world units, for distances
+    uint64_t blockCount = 0;
+};
+static_assert(sizeof(SparseVolumeHeader) == 48);
+
+// Writes the blocks as they are given. The block count is written when the file is closed.
+class SparseVolumeWriter {
+public:
+    SparseVolumeWriter(const std::string& path, const SparseVolumeHeader& header)
+        : file{path, std::ios::binary | std::ios::trunc}, header{header}
+    {
+        if (!file) {
+            throw std::runtime_error("Failed to open " + path);
+        }
+        this->header.blockCount = 0;
+        write(&this->header, sizeof(SparseVolumeHeader));
+    }
+
+    SparseVolumeWriter(const SparseVolumeWriter&) = delete;
+    SparseVolumeWriter& operator=(const SparseVolumeWriter&) = delete;
+
+    ~SparseVolumeWriter()
+    {
+        if (file.is_open()) {
+            writeBlockCount();
+        }
+    }
+
+    const SparseVolumeHeader& getHeader() const { return header; }
+
+    void writeBlock(const glm::ivec3& block, std::span<const float, KV> values)
+    {
+        write(&block, sizeof(glm::ivec3));
+        write(values.data(), values.size_bytes());
+        header.blockCount++;
+    }
+
+    // Unlike the destructor, throws if the file could not be completed
+    void close()
+    {
+        writeBlockCount();
+        file.close();
+        if (file.fail()) {
+            throw std::runtime_error("Failed to write the sparse volume");
+        }
+    }
+
+private:
+    void writeBlockCount()
+    {
+        file.seekp(offsetof(SparseVolumeHeader, blockCount));
+        file.write(reinterpret_cast<const char*>(&header.blockCount), sizeof(uint64_t));
+    }
+
+    void write(const void* data, size_t size)
+    {
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!file) {
+            throw std::runtime_error("Failed to write the sparse volume");
+        }
+    }
+
+    std::ofstream file;
+    SparseVolumeHeader header;
+};
+
+// Reads the blocks one after another
+class SparseVolumeReader {
+public:
+    explicit SparseVolumeReader(const std::string& path) : file{path, std::ios::binary}
+    {
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(SparseVolumeHeader))
+            || header.magic != SparseVolumeHeader::currentMagic) {
+            throw std::runtime_error("Not a sparse volume: " + path);
+        }
+        if (header.version != SparseVolumeHeader::currentVersion
+            || header.blockResolution != K) {
+            throw std::runtime_error("Unsupported sparse volume: " + path);
+        }
+    }
+
+    const SparseVolumeHeader& getHeader() const { return header; }
+
+    // Returns false after the last block
+    bool readBlock(glm::ivec3& block, std::array<float, KV>& values)
+    {
+        if (readBlockCount == header.blockCount) {
+            return false;
+        }
+        file.read(reinterpret_cast<char*>(&block), sizeof(glm::ivec3));
+        file.read(reinterpret_cast<char*>(values.data()), sizeof(float) * KV);
+        if (!file) {
+            throw std::runtime_error("Truncated sparse volume");
+        }
+        readBlockCount++;
+        return true;
+    }
+
+private:
+    std::ifstream file;
+    SparseVolumeHeader header;
+    uint64_t readBlockCount = 0;
+};
+
+// Write the surface blocks of a reconstruction with the value type of the writer.
+// The reconstruction must have the densities of whole blocks (see
+// ReconstructionParams::evaluateBlocks).
+// Distances are the density difference to the iso value divided by the gradient, from
+// differences inside the block, which is accurate near the surface.
+inline void writeSurfaceBlocks(const Reconstruction& reconstruction, SparseVolumeWriter& writer)
+{
+    if (reconstruction.blockDensities.size() != reconstruction.surfaceBlocks.size() * KV) {
+        throw std::invalid_argument("The reconstruction has no densities of whole blocks");
+    }
+
+    const SparseVolumeHeader& header = writer.getHeader();
+    float cellSize = reconstruction.gridOrigin.w;
+    std::array<float, KV> values;
+    for (size_t i = 0; i < reconstruction.surfaceBlocks.size(); i++) {
+        glm::ivec3 block = glm::ivec3(to3D(reconstruction.surfaceBlocks[i], M));
+        std::span<const float, KV> densities{reconstruction.blockDensities.data() + i * KV, KV};
+        if (header.valueType == SparseVolumeValue::Density) {
+            writer.writeBlock(block, densities);
+            continue;
+        }
+
+        auto getDensity = [&](const glm::ivec3& vertex) {
+            return densities[to1D(glm::uvec3(vertex), K + 1)];
+        };
+        for (uint32_t localVertexIndex = 0; localVertexIndex < KV; localVertexIndex++) {
+            glm::ivec3 vertex = glm::ivec3(to3D(localVertexIndex, K + 1));
+            glm::vec3 gradient;
+            for (int axis = 0; axis < 3; axis++) {
+                // Central differences, one-sided on the faces of the block
+                glm::ivec3 lo = vertex;
+                glm::ivec3 hi = vertex;
+                lo[axis] = std::max(vertex[axis] - 1, 0);
+                hi[axis] = std::min(vertex[axis] + 1, K);
+                gradient[axis] = (getDensity(hi) - getDensity(lo))
+                                 / (static_cast<float>(hi[axis] - lo[axis]) * cellSize);
+            }
+            float difference = header.isoValue - densities[localVertexIndex];
+            float length = glm::length(gradient);
+            float distance = length > 0.0f ? difference / length
+                                           : std::copysign(header.bandWidth, difference);
+            values[localVertexIndex] = std::clamp(distance, -header.bandWidth, header.bandWidth);
+        }
+        writer.writeBlock(block, values);
+    }
+}
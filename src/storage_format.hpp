@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "../shader/shared.inc"
+
+// Reduced precision storage of the densities and normals
+
+// Round trip of a density through storeDensity() and loadDensity() in shared.glsl
+inline float quantizeDensity(float density, uint32_t storageFormat, float isoValue)
+{
+    switch (storageFormat & densityFormatMask) {
+        case densityFloat16:
+            return glm::unpackHalf2x16(glm::packHalf2x16(glm::vec2(density, 0.0f))).x;
+        case densityUnorm16: {
+            float range = densityUnormRange * isoValue;
+            glm::vec2 packed = glm::vec2(density / range, 0.0f);
+            return glm::unpackUnorm2x16(glm::packUnorm2x16(packed)).x * range;
+        }
+        default:
+            return density;
+    }
+}
+
+// Same as encodeOctahedral() in shared.glsl
+inline glm::vec2 encodeOctahedral(glm::vec3 normal)
+{
+    normal /= std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    glm::vec2 signs{normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f};
+    return normal.z >= 0.0f ? glm::vec2(normal)
+                            : (1.0f - glm::abs(glm::vec2(normal.y, normal.x))) * signs;
+}
+
+// Same as decodeOctahedral() in shared.glsl
+inline glm::vec3 decodeOctahedral(const glm::vec2& e)
+{
+    glm::vec3 normal{e, 1.0f - std::abs(e.x) - std::abs(e.y)};
+    float t = std::max(-normal.z, 0.0f);
+    normal.x += normal.x >= 0.0f ? -t : t;
+    normal.y += normal.y >= 0.0f ? -t : t;
+    return glm::normalize(normal);
+}
+
+// Round trip of a normal through storeNormal() and loadNormal() in shared.glsl
+inline glm::vec3 quantizeNormal(const glm::vec3& normal, uint32_t storageFormat)
+{
+    if ((storageFormat & octahedralNormals) == 0) {
+        return normal;
+    }
+    return decodeOctahedral(glm::unpackSnorm2x16(glm::packSnorm2x16(encodeOctahedral(normal))));
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <stdexcept>
+#include <vector>
+
+#include "../shader/shared.inc"
+
+// 64-bit index math for grids that do not fit in a single N^3 grid
+inline uint64_t to1D(const glm::u64vec3& indices, uint64_t num)
+{
+    return (num * num * indices.z) + (num * indices.y) + indices.x;
+}
+
+inline glm::u64vec3 to3D(uint64_t index, uint64_t num)
+{
+    return {index % num, (index % (num * num)) / num, index / (num * num)};
+}
+
+// The whole area is divided into tiles of N^3 cells.
+// Each tile overlaps its neighbors by a halo of blocks that covers the kernel support,
+// and only the blocks inside the halo are polygonized, so that the tiles stitch seamlessly.
+// The tiles share the grid buffers of a single N^3 grid and are processed one after another,
+// so the grid memory does not grow with the resolution.
+class TilePlan {
+public:
+    struct Tile
+    {
+        glm::uvec3 coord{0};
+        glm::ivec3 blockOffset{0};  // global block indices of the local block (0, 0, 0)
+        glm::vec3 origin{0.0f};     // world position of the local vertex (0, 0, 0)
+        uint64_t particleOffset = 0;
+        uint32_t particleCount = 0;
+    };
+
+    TilePlan() = default;
+
+    // resolution: number of cells per axis of the whole area
+    TilePlan(uint32_t resolution, float kernelRadius)
+        : resolution{resolution}
+    {
+        if (resolution % K != 0) {
+            throw std::runtime_error("Tile resolution must be a multiple of the block size");
+        }
+        cellSize = areaSize.x / static_cast<float>(resolution);
+
+        // The kernel reads up to offsetSize + 1 cells, and isSurface one more
+        int offsetSize = static_cast<int>(kernelRadius / cellSize);
+        haloBlocks = (offsetSize + 2 + K - 1) / K;
+        if (2 * haloBlocks >= static_cast<uint32_t>(M)) {
+            throw std::runtime_error("Kernel radius is too large for the tile size");
+        }
+
+        innerBlocks = M - 2 * haloBlocks;
+        uint32_t globalBlocks = resolution / K;
+        tilesPerAxis = (globalBlocks + innerBlocks - 1) / innerBlocks;
+        if (resolution == N) {
+            // The whole area fits in one grid, so no halo is needed
+            haloBlocks = 0;
+            innerBlocks = M;
+            tilesPerAxis = 1;
+        }
+
+        for (uint32_t z = 0; z < tilesPerAxis; z++) {
+            for (uint32_t y = 0; y < tilesPerAxis; y++) {
+                for (uint32_t x = 0; x < tilesPerAxis; x++) {
+                    Tile tile;
+                    tile.coord = {x, y, z};
+                    tile.blockOffset = glm::ivec3(tile.coord * innerBlocks)
+                                       - glm::ivec3(static_cast<int>(haloBlocks));
+                    tile.origin = areaOrigin + glm::vec3(tile.blockOffset) * (cellSize * K);
+                    tiles.push_back(tile);
+                }
+            }
+        }
+    }
+
+    // Sort the particles into the tiles, including the halo of each tile.
+    // A particle near a tile boundary is stored in every tile that overlaps it.
+    // The GPU indexes the sorted particles with 32 bits, so their total count must fit.
+    // If attributes is not null, the attributes of the particles are sorted in the same way.
+    void binParticles(const glm::vec4* particles,
+                      uint32_t count,
+                      std::vector<glm::vec4>& tileParticles,
+                      const glm::vec4* attributes = nullptr,
+                      std::vector<glm::vec4>* tileAttributes = nullptr)
+    {
+        for (auto& tile : tiles) {
+            tile.particleCount = 0;
+        }
+
+        auto forEachTile = [&](const glm::vec4& particle, auto&& func) {
+            glm::ivec3 minTile, maxTile;
+            if (!getTileRange(glm::vec3(particle), minTile, maxTile)) {
+                return;
+            }
+            for (int z = minTile.z; z <= maxTile.z; z++) {
+                for (int y = minTile.y; y <= maxTile.y; y++) {
+                    for (int x = minTile.x; x <= maxTile.x; x++) {
+                        func(tiles[to1D(glm::u64vec3(x, y, z), tilesPerAxis)]);
+                    }
+                }
+            }
+        };
+
+        // Count, then scatter
+        for (uint32_t i = 0; i < count; i++) {
+            forEachTile(particles[i], [](Tile& tile) { tile.particleCount++; });
+        }
+        uint64_t offset = 0;
+        for (auto& tile : tiles) {
+            tile.particleOffset = offset;
+            offset += tile.particleCount;
+            tile.particleCount = 0;
+        }
+        if (offset > UINT32_MAX) {
+            throw std::runtime_error("Too many particles in the tiles for 32-bit offsets");
+        }
+        tileParticles.resize(offset);
+        if (attributes) {
+            tileAttributes->resize(offset);
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            forEachTile(particles[i], [&](Tile& tile) {
+                uint64_t index = tile.particleOffset + tile.particleCount++;
+                tileParticles[index] = particles[i];
+                if (attributes) {
+                    (*tileAttributes)[index] = attributes[i];
+                }
+            });
+        }
+    }
+
+    // Grid constants to process the given tile
+    void setGridConstants(const Tile& tile, GridConstants& gridConstants) const
+    {
+        gridConstants.gridOrigin = glm::vec4{tile.origin, cellSize};
+        gridConstants.tileInfo.x = static_cast<uint32_t>(tile.particleOffset);
+        gridConstants.tileInfo.y = haloBlocks;
+        gridConstants.maxParticleCount = tile.particleCount;
+    }
+
+    uint64_t getTileCount() const { return uint64_t(tilesPerAxis) * tilesPerAxis * tilesPerAxis; }
+
+    uint32_t resolution = N;
+    uint32_t haloBlocks = 0;
+    uint32_t innerBlocks = M;
+    uint32_t tilesPerAxis = 1;
+    float cellSize = areaSize.x / N;
+    std::vector<Tile> tiles;
+
+private:
+    // Range of tiles whose grid (including the halo) contains the position
+    bool getTileRange(const glm::vec3& worldPos, glm::ivec3& minTile, glm::ivec3& maxTile) const
+    {
+        glm::vec3 blockPos = (worldPos - areaOrigin) / (cellSize * K);
+        glm::vec3 inner = glm::vec3(static_cast<float>(innerBlocks));
+        glm::vec3 halo = glm::vec3(static_cast<float>(haloBlocks));
+
+        // tile t covers the blocks [t * inner - halo, (t + 1) * inner + halo)
+        minTile = glm::ivec3(glm::floor((blockPos - inner - halo) / inner)) + 1;
+        maxTile = glm::ivec3(glm::floor((blockPos + halo) / inner));
+        minTile = glm::max(minTile, glm::ivec3(0));
+        maxTile = glm::min(maxTile, glm::ivec3(static_cast<int>(tilesPerAxis) - 1));
+        return glm::all(glm::lessThanEqual(minTile, maxTile));
+    }
+};
@@ -0,0 +1,172 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// Lifetime-based aliasing of the grid buffers of a frame, as in a frame graph.
+//
+// Each buffer is live from the stage that writes it first to the last stage that reads it.
+// Buffers whose lifetimes do not overlap share an allocation sized for the largest of them.
+// A buffer must be cleared when its lifetime begins, since an allocation holds the data of
+// the previous buffer until then.
+class TransientArena {
+public:
+    TransientArena() = default;
+
+    explicit TransientArena(std::vector<std::string> stageNames)
+        : stageNames{std::move(stageNames)}
+    {
+    }
+
+    // Live in [firstStage, lastStage]. Returns the index of the buffer.
+    uint32_t add(std::string name, uint64_t size, uint32_t firstStage, uint32_t lastStage)
+    {
+        buffers.push_back({std::move(name), size, firstStage, std::max(firstStage, lastStage)});
+        return static_cast<uint32_t>(buffers.size() - 1);
+    }
+
+    // Assign the buffers to allocations, the largest buffers first.
+    // A buffer goes to the allocation it grows the least, among those it does not overlap.
+    void build()
+    {
+        std::vector<uint32_t> order(buffers.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return buffers[a].size > buffers[b].size;
+        });
+
+        allocations.clear();
+        for (uint32_t index : order) {
+            Buffer& buffer = buffers[index];
+            uint32_t best = UINT32_MAX;
+            uint64_t bestGrowth = UINT64_MAX;
+            for (uint32_t a = 0; a < allocations.size(); a++) {
+                uint64_t growth = buffer.size - std::min(buffer.size, allocations[a].size);
+                if (growth < bestGrowth && !overlaps(allocations[a], buffer)) {
+                    best = a;
+                    bestGrowth = growth;
+                }
+            }
+            if (best == UINT32_MAX) {
+                best = static_cast<uint32_t>(allocations.size());
+                allocations.push_back({});
+            }
+            allocations[best].size = std::max(allocations[best].size, buffer.size);
+            allocations[best].buffers.push_back(index);
+            buffer.allocation = best;
+        }
+    }
+
+    uint32_t getBufferCount() const { return static_cast<uint32_t>(buffers.size()); }
+
+    uint32_t getAllocationCount() const { return static_cast<uint32_t>(allocations.size()); }
+
+    uint64_t getAllocationSize(uint32_t allocation) const { return allocations[allocation].size; }
+
+    uint32_t getAllocation(uint32_t buffer) const { return buffers[buffer].allocation; }
+
+    // Buffers to be cleared before the stage runs
+    std::vector<uint32_t> getBuffersStartingAt(uint32_t stage) const
+    {
+        std::vector<uint32_t> starting;
+        for (uint32_t i = 0; i < buffers.size(); i++) {
+            if (buffers[i].firstStage == stage) {
+                starting.push_back(i);
+            }
+        }
+        return starting;
+    }
+
+    // Bytes of the live buffers during the stage
+    uint64_t getLiveSize(uint32_t stage) const
+    {
+        uint64_t size = 0;
+        for (const Buffer& buffer : buffers) {
+            if (buffer.firstStage <= stage && stage <= buffer.lastStage) {
+                size += buffer.size;
+            }
+        }
+        return size;
+    }
+
+    uint64_t getTotalSize() const
+    {
+        uint64_t size = 0;
+        for (const Allocation& allocation : allocations) {
+            size += allocation.size;
+        }
+        return size;
+    }
+
+    uint64_t getUnaliasedSize() const
+    {
+        uint64_t size = 0;
+        for (const Buffer& buffer : buffers) {
+            size += buffer.size;
+        }
+        return size;
+    }
+
+    // One line per stage and per allocation, in MB
+    std::vector<std::string> getReport() const
+    {
+        auto toMB = [](uint64_t size) {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.1f MB", static_cast<double>(size) / 1024 / 1024);
+            return std::string{text};
+        };
+
+        std::vector<std::string> lines;
+        lines.push_back("Transient buffers: " + toMB(getTotalSize()) + " in "
+                        + std::to_string(allocations.size()) + " allocations ("
+                        + toMB(getUnaliasedSize()) + " without aliasing)");
+        uint64_t peak = 0;
+        for (uint32_t stage = 0; stage < stageNames.size(); stage++) {
+            peak = std::max(peak, getLiveSize(stage));
+            lines.push_back("  " + stageNames[stage] + ": " + toMB(getLiveSize(stage)) + " live");
+        }
+        lines.push_back("  Peak: " + toMB(peak));
+        for (uint32_t a = 0; a < allocations.size(); a++) {
+            std::string line = "  Allocation " + std::to_string(a) + " ("
+                               + toMB(allocations[a].size) + "):";
+            for (uint32_t index : allocations[a].buffers) {
+                line += " " + buffers[index].name;
+            }
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+private:
+    struct Buffer
+    {
+        std::string name;
+        uint64_t size = 0;
+        uint32_t firstStage = 0;
+        uint32_t lastStage = 0;
+        uint32_t allocation = 0;
+    };
+
+    struct Allocation
+    {
+        uint64_t size = 0;
+        std::vector<uint32_t> buffers;
+    };
+
+    bool overlaps(const Allocation& allocation, const Buffer& buffer) const
+    {
+        return std::any_of(allocation.buffers.begin(), allocation.buffers.end(),
+                           [&](uint32_t index) {
+                               const Buffer& other = buffers[index];
+                               return other.firstStage <= buffer.lastStage
+                                      && buffer.firstStage <= other.lastStage;
+                           });
+    }
+
+    std::vector<std::string> stageNames;
+    std::vector<Buffer> buffers;
+    std::vector<Allocation> allocations;
+};
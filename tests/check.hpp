@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+// Checks that stay enabled in release builds. A failed check prints its location and exits,
+// which ctest reports as a failed test.
+#define CHECK(condition)                                                                       \
+    do {                                                                                       \
+        if (!(condition)) {                                                                    \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(EXIT_FAILURE);                                                           \
+        }                                                                                      \
+    } while (false)
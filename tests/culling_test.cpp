@@ -0,0 +1,114 @@
+#include "src/culling.hpp"
+#include "tests/check.hpp"
+
+namespace {
+
+constexpr float nearPlane = 0.1f;
+constexpr float farPlane = 100.0f;
+
+// Camera at the origin looking down -z with a 90 degree field of view and depth in [0, 1]
+glm::mat4 createViewProj()
+{
+    glm::mat4 proj{0.0f};
+    proj[0][0] = 1.0f;
+    proj[1][1] = 1.0f;
+    proj[2][2] = farPlane / (nearPlane - farPlane);
+    proj[2][3] = -1.0f;
+    proj[3][2] = -(farPlane * nearPlane) / (farPlane - nearPlane);
+    return proj;
+}
+
+float getDepth(float viewZ)
+{
+    glm::vec4 clipPos = createViewProj() * glm::vec4(0.0f, 0.0f, viewZ, 1.0f);
+    return clipPos.z / clipPos.w;
+}
+
+HiZPyramid createPyramid(int width, int height, float depth)
+{
+    return HiZPyramid{std::vector<float>(width * height, depth), width, height};
+}
+
+void testFrustum()
+{
+    glm::mat4 viewProj = createViewProj();
+    CHECK(isBoxVisible({-1, -1, -11}, {1, 1, -9}, viewProj));
+
+    // Outside each plane
+    CHECK(!isBoxVisible({-30, -1, -11}, {-20, 1, -9}, viewProj));  // left
+    CHECK(!isBoxVisible({20, -1, -11}, {30, 1, -9}, viewProj));    // right
+    CHECK(!isBoxVisible({-1, -30, -11}, {1, -20, -9}, viewProj));  // bottom
+    CHECK(!isBoxVisible({-1, 20, -11}, {1, 30, -9}, viewProj));    // top
+    CHECK(!isBoxVisible({-0.01f, -0.01f, -0.09f}, {0.01f, 0.01f, -0.05f}, viewProj));  // near
+    CHECK(!isBoxVisible({-1, -1, -200}, {1, 1, -150}, viewProj));  // far
+
+    // Behind the camera
+    CHECK(!isBoxVisible({-1, -1, 5}, {1, 1, 10}, viewProj));
+
+    // Outside the planes of the corners in front, but crossing the camera plane
+    HiZPyramid occluder = createPyramid(8, 8, 0.0f);
+    CHECK(isBoxVisible({-1, -1, -5}, {1, 1, 5}, viewProj));
+    CHECK(isBoxVisible({-1, -1, -5}, {1, 1, 5}, viewProj, &occluder));
+}
+
+void testOcclusion()
+{
+    glm::mat4 viewProj = createViewProj();
+    HiZPyramid hiZ = createPyramid(64, 64, getDepth(-5.0f));
+
+    // Fully behind the occluder
+    CHECK(!isBoxVisible({-1, -1, -20}, {1, 1, -19}, viewProj, &hiZ));
+
+    // Partly in front of the occluder
+    CHECK(isBoxVisible({-1, -1, -20}, {1, 1, -4}, viewProj, &hiZ));
+
+    // Fully in front of the occluder
+    CHECK(isBoxVisible({-1, -1, -4}, {1, 1, -3}, viewProj, &hiZ));
+}
+
+void testOddPyramid()
+{
+    // The last column of a 7x5 image is empty, the rest is covered by a near occluder
+    const int width = 7;
+    const int height = 5;
+    float occluderDepth = getDepth(-0.5f);
+    std::vector<float> depth(width * height, occluderDepth);
+    for (int y = 0; y < height; y++) {
+        depth[y * width + width - 1] = 1.0f;
+    }
+    HiZPyramid hiZ{depth, width, height};
+
+    CHECK(hiZ.levelSizes.size() == 4);
+    CHECK(hiZ.levelSizes[1] == glm::ivec2(4, 3));
+    CHECK(hiZ.levelSizes[2] == glm::ivec2(2, 2));
+    CHECK(hiZ.levelSizes[3] == glm::ivec2(1, 1));
+
+    // The odd edge texels cover a single column or row of the level below
+    CHECK(hiZ.fetch(1, 3, 0) == 1.0f);
+    CHECK(hiZ.fetch(1, 2, 0) == occluderDepth);
+    CHECK(hiZ.fetch(1, 0, 2) == occluderDepth);
+    CHECK(hiZ.fetch(2, 1, 1) == 1.0f);
+    CHECK(hiZ.fetch(2, 0, 1) == occluderDepth);
+    CHECK(hiZ.fetch(3, 0, 0) == 1.0f);
+
+    glm::mat4 viewProj = createViewProj();
+
+    // Inside the last column, tested at level 0
+    CHECK(isBoxVisible({7.4f, -0.5f, -10.0f}, {9.0f, 0.5f, -9.0f}, viewProj, &hiZ));
+
+    // From the middle to the last column, tested at a coarser level
+    CHECK(isBoxVisible({2.0f, -0.5f, -10.0f}, {9.0f, 0.5f, -9.0f}, viewProj, &hiZ));
+
+    // Only over the occluded columns
+    CHECK(!isBoxVisible({-2.0f, -0.5f, -10.0f}, {1.0f, 0.5f, -9.0f}, viewProj, &hiZ));
+}
+
+}  // namespace
+
+int main()
+{
+    testFrustum();
+    testOcclusion();
+    testOddPyramid();
+    return 0;
+}
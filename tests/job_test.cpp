@@ -0,0 +1,111 @@
+#include <set>
+#include <thread>
+
+#include "src/job.hpp"
+#include "tests/check.hpp"
+
+namespace {
+
+constexpr uint32_t frameCount = 24;
+constexpr uint32_t workerCount = 3;
+
+// Frame i has i + 1 particles, all at x = i
+SharedParticleCache createCache()
+{
+    std::vector<glm::vec4> particles;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> offsets;
+    for (uint32_t i = 0; i < frameCount; i++) {
+        offsets.push_back(static_cast<uint32_t>(particles.size()));
+        counts.push_back(i + 1);
+        particles.insert(particles.end(), i + 1, glm::vec4(float(i), 0.0f, 0.0f, 0.0f));
+    }
+    return SharedParticleCache{particles, counts, offsets};
+}
+
+// A mesh with a single vertex holding the particle count and the position of the first particle.
+// Earlier frames take longer, so that the results finish out of order.
+SurfaceMesh reconstructDummy(const glm::vec4* particles, uint32_t count)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds((frameCount - count) % 4));
+    SurfaceMesh mesh;
+    mesh.positions.push_back(glm::vec3(float(count), particles[0].x, 0.0f));
+    mesh.normals.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
+    return mesh;
+}
+
+void testOrder(JobRunner::Mode mode)
+{
+    SharedParticleCache cache = createCache();
+
+    // Every other frame, in reverse
+    std::vector<int> frames;
+    for (int i = frameCount - 1; i >= 0; i -= 2) {
+        frames.push_back(i);
+    }
+
+    std::vector<int> delivered;
+    std::set<uint32_t> workers;
+    JobRunner runner{mode, workerCount};
+    runner.run(
+        cache, frames, [](uint32_t) -> FrameFunc { return reconstructDummy; },
+        [&](FrameResult&& result) {
+            CHECK(result.workerIndex < workerCount);
+            CHECK(result.mesh.positions.size() == 1);
+            CHECK(result.mesh.positions[0].x == float(result.frame + 1));
+            CHECK(result.mesh.positions[0].y == float(result.frame));
+            delivered.push_back(result.frame);
+            workers.insert(result.workerIndex);
+        });
+
+    // Each frame exactly once, in the order of the frame list
+    CHECK(delivered == frames);
+    CHECK(!workers.empty());
+}
+
+void testException(JobRunner::Mode mode)
+{
+    SharedParticleCache cache = createCache();
+    std::vector<int> frames;
+    for (uint32_t i = 0; i < frameCount; i++) {
+        frames.push_back(static_cast<int>(i));
+    }
+
+    auto createWorker = [](uint32_t) -> FrameFunc {
+        return [](const glm::vec4* particles, uint32_t count) {
+            if (count == 5) {
+                throw std::runtime_error("dummy failure");
+            }
+            return reconstructDummy(particles, count);
+        };
+    };
+
+    // Frames after the failed one are never delivered
+    int lastFrame = -1;
+    bool threw = false;
+    try {
+        JobRunner runner{mode, workerCount};
+        runner.run(cache, frames, createWorker, [&](FrameResult&& result) {
+            CHECK(result.frame == lastFrame + 1);
+            lastFrame = result.frame;
+        });
+    } catch (const std::runtime_error& error) {
+        // Threads rethrow the exception of the worker, processes only report their exit status
+        threw = mode == JobRunner::Mode::Process || std::string{error.what()} == "dummy failure";
+    }
+    CHECK(threw);
+    CHECK(lastFrame == 3);
+}
+
+}  // namespace
+
+int main()
+{
+    testOrder(JobRunner::Mode::Thread);
+    testException(JobRunner::Mode::Thread);
+#if defined(__unix__)
+    testOrder(JobRunner::Mode::Process);
+    testException(JobRunner::Mode::Process);
+#endif
+    return 0;
+}
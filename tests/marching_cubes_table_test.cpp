@@ -0,0 +1,117 @@
+#include "src/marching_cubes_table.hpp"
+#include "tests/check.hpp"
+
+namespace {
+
+// Same as getTriangleEdge() in marching_cubes_table.glsl
+uint32_t unpackTriangleEdge(const PackedTriangles& triangles, uint32_t i)
+{
+    return (triangles[i / 8] >> (i % 8 * 4)) & 0xF;
+}
+
+// Same as getCellBlockEdges() and cellEdgeToBlockEdge() in surface.mesh
+uint32_t unpackBlockEdge(uint32_t localCellIndex, uint32_t cellEdge, uint32_t groupIndexInBlock)
+{
+    uint32_t first = (localCellIndex - groupIndexInBlock * 32) * 3;
+    return (packedBlockEdgeTable[first + cellEdge / 4] >> (cellEdge % 4 * 8)) & 0xFF;
+}
+
+// cellEdgeToBlockEdge() of surface.mesh before the block edges were precomputed
+uint32_t computeBlockEdge(uint32_t localCellIndex, uint32_t cellEdge, uint32_t groupIndexInBlock)
+{
+    const uint32_t edgeOffsets[12] = {0, 61, 4, 60, 20, 81, 24, 80, 120, 121, 126, 125};
+    localCellIndex -= groupIndexInBlock * 32;
+    uint32_t firstEdge = localCellIndex % 16 + (localCellIndex / 16) * 20;
+    uint32_t j = localCellIndex / K % K;
+    uint32_t k = localCellIndex / (K * K);
+
+    uint32_t val = firstEdge + edgeOffsets[cellEdge];
+    if (cellEdge >= 8) {
+        return val + j + 5 * k;
+    } else if (cellEdge % 2 == 1) {
+        return val + j;
+    }
+    return val;
+}
+
+void testTriangleTable()
+{
+    const MarchingCubesTables tables;
+    for (uint32_t mcCase = 0; mcCase < 256; mcCase++) {
+        const PackedTriangles& triangles = tables.packedTriangles[mcCase];
+
+        // The rows of the old table end at the first -1
+        uint32_t edgeCount = 0;
+        while (edgeCount < 12 && triangleTable[mcCase][edgeCount] != -1) {
+            edgeCount++;
+        }
+        CHECK(edgeCount == triangleCounts[mcCase] * 3);
+        CHECK(triangles[1] >> packedTriangleCountShift == triangleCounts[mcCase]);
+
+        for (uint32_t i = 0; i < edgeCount; i++) {
+            CHECK(static_cast<int>(unpackTriangleEdge(triangles, i)) == triangleTable[mcCase][i]);
+        }
+
+        // The unused fields stay zero, so the count is all the top bits hold
+        for (uint32_t i = edgeCount; i < 12; i++) {
+            CHECK(unpackTriangleEdge(triangles, i) == 0);
+        }
+        CHECK((triangles[1] & 0x0FFF0000) == 0);
+    }
+}
+
+void testBlockEdgeTable()
+{
+    static_assert(K == 4);
+    for (uint32_t localCellIndex = 0; localCellIndex < KC; localCellIndex++) {
+        uint32_t groupIndexInBlock = localCellIndex / blockHalfCellCount;
+        for (uint32_t cellEdge = 0; cellEdge < 12; cellEdge++) {
+            uint32_t blockEdge = unpackBlockEdge(localCellIndex, cellEdge, groupIndexInBlock);
+            CHECK(blockEdge == computeBlockEdge(localCellIndex, cellEdge, groupIndexInBlock));
+            CHECK(blockEdge < blockHalfEdgeCount);
+        }
+    }
+}
+
+// The triangle edges on each face of a cell pair up the crossings on the edges of that face,
+// which the stitching of faces between LODs in surface.mesh relies on
+void testFaceSegments()
+{
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        for (uint32_t side = 0; side < 2; side++) {
+            auto isOnFace = [&](int32_t edge) {
+                return vertexIndexToOffset[edgeVertexIndices[edge][0]][axis] == side
+                       && vertexIndexToOffset[edgeVertexIndices[edge][1]][axis] == side;
+            };
+            for (uint32_t mcCase = 0; mcCase < 256; mcCase++) {
+                uint32_t segmentCounts[12] = {};
+                for (uint32_t i = 0; i < triangleCounts[mcCase] * 3; i++) {
+                    int32_t edge0 = triangleTable[mcCase][i];
+                    int32_t edge1 = triangleTable[mcCase][i % 3 == 2 ? i - 2 : i + 1];
+                    if (isOnFace(edge0) && isOnFace(edge1)) {
+                        segmentCounts[edge0]++;
+                        segmentCounts[edge1]++;
+                    }
+                }
+                for (int32_t edge = 0; edge < 12; edge++) {
+                    if (!isOnFace(edge)) {
+                        continue;
+                    }
+                    bool inside0 = (mcCase >> edgeVertexIndices[edge][0]) & 1;
+                    bool inside1 = (mcCase >> edgeVertexIndices[edge][1]) & 1;
+                    CHECK(segmentCounts[edge] == (inside0 != inside1 ? 1 : 0));
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main()
+{
+    testTriangleTable();
+    testBlockEdgeTable();
+    testFaceSegments();
+    return 0;
+}
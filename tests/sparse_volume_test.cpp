@@ -0,0 +1,123 @@
+#include <filesystem>
+#include <random>
+
+#include "src/sparse_volume.hpp"
+#include "tests/check.hpp"
+
+namespace {
+
+// A ball of particles in the middle of the area
+std::vector<glm::vec4> createBall()
+{
+    std::mt19937 random{1};
+    std::uniform_real_distribution<float> distribution{-1.0f, 1.0f};
+    glm::vec3 center = areaOrigin + areaSize * 0.5f;
+    std::vector<glm::vec4> particles;
+    while (particles.size() < 20000) {
+        glm::vec3 p{distribution(random), distribution(random), distribution(random)};
+        if (glm::length(p) < 1.0f) {
+            particles.push_back(glm::vec4(center + p * areaSize.x * 0.2f, 0.0f));
+        }
+    }
+    return particles;
+}
+
+// Write the blocks and read them back, checking the header and the block coordinates.
+// Returns the values of the blocks in the order of the reconstruction.
+std::vector<float> writeAndRead(const Reconstruction& reconstruction,
+                                const SparseVolumeHeader& header,
+                                const std::filesystem::path& path)
+{
+    SparseVolumeWriter writer{path.string(), header};
+    writeSurfaceBlocks(reconstruction, writer);
+    writer.close();
+
+    SparseVolumeReader reader{path.string()};
+    const SparseVolumeHeader& readHeader = reader.getHeader();
+    CHECK(readHeader.valueType == header.valueType);
+    CHECK(readHeader.gridOrigin == header.gridOrigin);
+    CHECK(readHeader.isoValue == header.isoValue);
+    CHECK(readHeader.bandWidth == header.bandWidth);
+    CHECK(readHeader.blockCount == reconstruction.surfaceBlocks.size());
+
+    std::vector<float> values;
+    glm::ivec3 block;
+    std::array<float, KV> blockValues;
+    while (reader.readBlock(block, blockValues)) {
+        size_t blockIndex = values.size() / KV;
+        CHECK(blockIndex < reconstruction.surfaceBlocks.size());
+        CHECK(glm::uvec3(block) == to3D(reconstruction.surfaceBlocks[blockIndex], M));
+        values.insert(values.end(), blockValues.begin(), blockValues.end());
+    }
+    CHECK(values.size() == reconstruction.blockDensities.size());
+    return values;
+}
+
+}  // namespace
+
+int main()
+{
+    std::vector<glm::vec4> particles = createBall();
+    ReconstructionParams params;
+    params.evaluateBlocks = true;
+    Reconstructor reconstructor;
+    reconstructor.setParticles(particles);
+    reconstructor.setParams(params);
+    const Reconstruction& reconstruction = reconstructor.reconstruct();
+    CHECK(!reconstruction.surfaceBlocks.empty());
+    CHECK(reconstruction.blockDensities.size() == reconstruction.surfaceBlocks.size() * KV);
+
+    // The block densities agree with those evaluated by the stages
+    std::vector<float> densities(numVertices, -1.0f);
+    for (size_t i = 0; i < reconstruction.surfaceVertices.size(); i++) {
+        densities[reconstruction.surfaceVertices[i]] = reconstruction.surfaceDensities[i];
+    }
+    size_t sharedCount = 0;
+    for (size_t i = 0; i < reconstruction.surfaceBlocks.size(); i++) {
+        glm::uvec3 block = to3D(reconstruction.surfaceBlocks[i], M);
+        for (uint32_t j = 0; j < KV; j++) {
+            float density = densities[to1D(block * uint32_t(K) + to3D(j, K + 1), N + 1)];
+            if (density >= 0.0f) {
+                CHECK(reconstruction.blockDensities[i * KV + j] == density);
+                sharedCount++;
+            }
+        }
+    }
+    CHECK(sharedCount > 0);
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "sparse_volume.spvl";
+
+    // Densities are written as they are
+    SparseVolumeHeader header;
+    header.gridOrigin = reconstruction.gridOrigin;
+    header.isoValue = params.isoValue;
+    CHECK(writeAndRead(reconstruction, header, path) == reconstruction.blockDensities);
+
+    // Distances are negative inside the surface and within the band
+    header.valueType = SparseVolumeValue::Distance;
+    header.bandWidth = 3.0f * reconstruction.gridOrigin.w;
+    std::vector<float> distances = writeAndRead(reconstruction, header, path);
+    bool hasInside = false;
+    for (size_t i = 0; i < distances.size(); i++) {
+        bool inside = reconstruction.blockDensities[i] > params.isoValue;
+        hasInside = hasInside || inside;
+        CHECK(inside ? distances[i] < 0.0f : distances[i] >= 0.0f);
+        CHECK(std::abs(distances[i]) <= header.bandWidth);
+    }
+    CHECK(hasInside);
+
+    // Without the densities of whole blocks, nothing is written
+    Reconstruction partial = reconstruction;
+    partial.blockDensities.clear();
+    bool threw = false;
+    try {
+        SparseVolumeWriter writer{path.string(), header};
+        writeSurfaceBlocks(partial, writer);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    std::filesystem::remove(path);
+    return 0;
+}